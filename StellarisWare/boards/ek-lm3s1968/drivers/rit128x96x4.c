@@ -58,6 +58,7 @@
 static volatile unsigned long g_ulSSIFlags;
 #define FLAG_SSI_ENABLED        0
 #define FLAG_DC_HIGH            1
+#define FLAG_QUEUE_ACTIVE       2
 
 //*****************************************************************************
 //
@@ -66,6 +67,46 @@ static volatile unsigned long g_ulSSIFlags;
 //*****************************************************************************
 static unsigned char g_pucBuffer[8];
 
+//*****************************************************************************
+//
+// The number of windows that can be queued to be drawn by the SSI interrupt,
+// and the number of bytes the SSI FIFOs hold.
+//
+//*****************************************************************************
+#define RIT_QUEUE_SIZE          16
+#define RIT_FIFO_SIZE           8
+
+//*****************************************************************************
+//
+// A window queued to be drawn by the SSI interrupt.  The command bytes set up
+// the window, then each row of the image is sent as data.
+//
+//*****************************************************************************
+typedef struct
+{
+    unsigned char pucCommand[8];
+    const unsigned char *pucImage;
+    unsigned long ulRowBytes;
+    unsigned long ulRows;
+    unsigned long ulStride;
+    unsigned long ulSent;
+}
+tRITWindow;
+
+//*****************************************************************************
+//
+// The queue of windows being drawn by the SSI interrupt.  The task side only
+// adds at the head and the interrupt only removes at the tail.  Bytes in
+// flight have been put in the transmit FIFO but not yet received back, so
+// are still being shifted out to the display.
+//
+//*****************************************************************************
+static tRITWindow g_psQueue[RIT_QUEUE_SIZE];
+static volatile unsigned long g_ulQueueHead;
+static volatile unsigned long g_ulQueueTail;
+static unsigned long g_ulInFlight;
+static void (*g_pfnQueueCallback)(void);
+
 //*****************************************************************************
 //
 // Define the SSD1329 128x96x4 Remap Setting(s).  This will be used in
@@ -336,6 +377,13 @@ RITWriteCommand(const unsigned char *pucBuffer, unsigned long ulCount)
         return;
     }
 
+    //
+    // Wait for any queued windows to be drawn so the bytes are not mixed up.
+    //
+    while(HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE))
+    {
+    }
+
     //
     // See if data mode is enabled.
     //
@@ -396,6 +444,13 @@ RITWriteData(const unsigned char *pucBuffer, unsigned long ulCount)
         return;
     }
 
+    //
+    // Wait for any queued windows to be drawn so the bytes are not mixed up.
+    //
+    while(HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE))
+    {
+    }
+
     //
     // See if command mode is enabled.
     //
@@ -668,6 +723,37 @@ void
 RIT128x96x4ImageDraw(const unsigned char *pucImage, unsigned long ulX,
                      unsigned long ulY, unsigned long ulWidth,
                      unsigned long ulHeight)
+{
+    RIT128x96x4ImageWindowDraw(pucImage, ulX, ulY, ulWidth, ulHeight,
+                               ulWidth / 2);
+}
+
+//*****************************************************************************
+//
+//! Displays a window into a larger image on the OLED display.
+//!
+//! \param pucImage is a pointer to the first byte of the window.
+//! \param ulX is the horizontal position to display the window, specified in
+//! columns from the left edge of the display.
+//! \param ulY is the vertical position to display the window, specified in
+//! rows from the top of the display.
+//! \param ulWidth is the width of the window, specified in columns.
+//! \param ulHeight is the height of the window, specified in rows.
+//! \param ulStride is the number of bytes from the start of one row of the
+//! image to the start of the next.
+//!
+//! This function is the same as RIT128x96x4ImageDraw(), except that the rows
+//! of the image may be further apart than the width of the window.  This
+//! allows a part of an off-screen frame buffer to be displayed without first
+//! copying it.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+RIT128x96x4ImageWindowDraw(const unsigned char *pucImage, unsigned long ulX,
+                           unsigned long ulY, unsigned long ulWidth,
+                           unsigned long ulHeight, unsigned long ulStride)
 {
     //
     // Check the arguments.
@@ -678,6 +764,7 @@ RIT128x96x4ImageDraw(const unsigned char *pucImage, unsigned long ulX,
     ASSERT((ulX + ulWidth) <= 128);
     ASSERT((ulY + ulHeight) <= 96);
     ASSERT((ulWidth & 1) == 0);
+    ASSERT(ulStride >= (ulWidth / 2));
 
     //
     // Setup a window starting at the specified column and row, and ending
@@ -707,10 +794,305 @@ RIT128x96x4ImageDraw(const unsigned char *pucImage, unsigned long ulX,
         //
         // Advance to the next row of the image.
         //
-        pucImage += (ulWidth / 2);
+        pucImage += ulStride;
     }
 }
 
+//*****************************************************************************
+//
+//! \internal
+//!
+//! Feeds the transmit FIFO from the queue of windows.
+//!
+//! Bytes are only put in the transmit FIFO while there is room for them in the
+//! receive FIFO, so every byte sent is received back and counted.  The
+//! command/data line is only changed once all the bytes before have been
+//! received, meaning that they have been shifted out to the display.  When
+//! the queue is empty and the last byte has been shifted out, the SSI
+//! interrupt is disabled and the callback is run.
+//!
+//! Must only be called with the SSI interrupt disabled or from it.
+//!
+//! \return None.
+//
+//*****************************************************************************
+static void
+RITQueueFeed(void)
+{
+    while(g_ulQueueTail != g_ulQueueHead)
+    {
+        tRITWindow *psWindow = &g_psQueue[g_ulQueueTail % RIT_QUEUE_SIZE];
+        unsigned long ulData = (psWindow->ulSent >= 8);
+        unsigned long ulByte;
+
+        //
+        // Change between command and data once the FIFO has emptied.
+        //
+        if(ulData != HWREGBITW(&g_ulSSIFlags, FLAG_DC_HIGH))
+        {
+            if(g_ulInFlight != 0)
+            {
+                return;
+            }
+            while(SSIBusy(SSI0_BASE))
+            {
+            }
+            GPIOPinWrite(GPIO_OLEDDC_BASE, GPIO_OLEDDC_PIN,
+                         ulData ? GPIO_OLEDDC_PIN : 0);
+            HWREGBITW(&g_ulSSIFlags, FLAG_DC_HIGH) = ulData;
+        }
+
+        //
+        // Send what fits in the FIFO of this window.
+        //
+        while(g_ulInFlight < RIT_FIFO_SIZE)
+        {
+            if(!ulData)
+            {
+                ulByte = psWindow->pucCommand[psWindow->ulSent];
+            }
+            else
+            {
+                ulByte = psWindow->ulSent - 8;
+                ulByte = psWindow->pucImage[(ulByte / psWindow->ulRowBytes) *
+                                            psWindow->ulStride +
+                                            (ulByte % psWindow->ulRowBytes)];
+            }
+            SSIDataPut(SSI0_BASE, ulByte);
+            g_ulInFlight++;
+            psWindow->ulSent++;
+
+            if((psWindow->ulSent == 8) ||
+               (psWindow->ulSent ==
+                (8 + (psWindow->ulRowBytes * psWindow->ulRows))))
+            {
+                break;
+            }
+        }
+
+        //
+        // Move on to the next window once this one is all in the FIFO.
+        //
+        if(psWindow->ulSent ==
+           (8 + (psWindow->ulRowBytes * psWindow->ulRows)))
+        {
+            g_ulQueueTail++;
+        }
+        else if(g_ulInFlight >= RIT_FIFO_SIZE)
+        {
+            return;
+        }
+    }
+
+    //
+    // Finish once the last byte has been shifted out.
+    //
+    if(g_ulInFlight == 0)
+    {
+        SSIIntDisable(SSI0_BASE, SSI_RXFF | SSI_RXTO);
+        HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE) = 0;
+        if(g_pfnQueueCallback)
+        {
+            g_pfnQueueCallback();
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! Handles the SSI interrupt while queued windows are drawn.
+//!
+//! This function counts the bytes received back for those sent and refills
+//! the transmit FIFO.  It is registered by RIT128x96x4QueueInit().
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+RIT128x96x4IntHandler(void)
+{
+    unsigned long ulTemp;
+
+    SSIIntClear(SSI0_BASE, SSIIntStatus(SSI0_BASE, true));
+
+    //
+    // Drain the receive fifo, each byte in it has been shifted out.
+    //
+    while(SSIDataGetNonBlocking(SSI0_BASE, &ulTemp) != 0)
+    {
+        g_ulInFlight--;
+    }
+
+    RITQueueFeed();
+}
+
+//*****************************************************************************
+//
+//! Sets up drawing windows from the SSI interrupt.
+//!
+//! \param pfnCallback is called from the SSI interrupt each time the queue of
+//! windows has been drawn, or may be 0.
+//!
+//! This function registers RIT128x96x4IntHandler() for the SSI interrupt.  The
+//! priority of the interrupt is left to the caller, and must allow whatever
+//! the callback does.
+//!
+//! \return None.
+//
+//*****************************************************************************
+void
+RIT128x96x4QueueInit(void (*pfnCallback)(void))
+{
+    g_pfnQueueCallback = pfnCallback;
+    SSIIntDisable(SSI0_BASE, SSI_TXFF | SSI_RXFF | SSI_RXTO | SSI_RXOR);
+    SSIIntRegister(SSI0_BASE, RIT128x96x4IntHandler);
+}
+
+//*****************************************************************************
+//
+//! Queues an image to be drawn on the OLED display from the SSI interrupt.
+//!
+//! \param pucImage is a pointer to the image data.
+//! \param ulX is the horizontal position of the image, specified in columns
+//! from the left edge of the display.
+//! \param ulY is the vertical position of the image, specified in rows from
+//! the top of the display.
+//! \param ulWidth is the width of the image, specified in columns.
+//! \param ulHeight is the height of the image, specified in rows.
+//! \param ulStride is the number of bytes from the start of one row of the
+//! image to the start of the next.
+//!
+//! This function takes the same parameters as RIT128x96x4ImageWindowDraw() but
+//! returns once the window is queued.  The image must not change until the
+//! callback given to RIT128x96x4QueueInit() has been run or
+//! RIT128x96x4QueueBusy() returns false.  The other drawing functions wait
+//! for the queue to be drawn before sending anything.
+//!
+//! \return Returns 1 if the window was queued, or 0 if the queue is full or
+//! the SSI port is not enabled.
+//
+//*****************************************************************************
+unsigned long
+RIT128x96x4ImageWindowQueue(const unsigned char *pucImage, unsigned long ulX,
+                            unsigned long ulY, unsigned long ulWidth,
+                            unsigned long ulHeight, unsigned long ulStride)
+{
+    tRITWindow *psWindow;
+    unsigned long ulTemp;
+
+    //
+    // Check the arguments.
+    //
+    ASSERT(ulX < 128);
+    ASSERT((ulX & 1) == 0);
+    ASSERT(ulY < 96);
+    ASSERT((ulX + ulWidth) <= 128);
+    ASSERT((ulY + ulHeight) <= 96);
+    ASSERT((ulWidth & 1) == 0);
+    ASSERT(ulStride >= (ulWidth / 2));
+
+    if(!HWREGBITW(&g_ulSSIFlags, FLAG_SSI_ENABLED) ||
+       ((g_ulQueueHead - g_ulQueueTail) >= RIT_QUEUE_SIZE))
+    {
+        return(0);
+    }
+
+    //
+    // Fill in the window at the head of the queue, setting it up as
+    // RIT128x96x4ImageWindowDraw() does.
+    //
+    psWindow = &g_psQueue[g_ulQueueHead % RIT_QUEUE_SIZE];
+    psWindow->pucCommand[0] = 0x15;
+    psWindow->pucCommand[1] = ulX / 2;
+    psWindow->pucCommand[2] = (ulX + ulWidth - 2) / 2;
+    psWindow->pucCommand[3] = 0x75;
+    psWindow->pucCommand[4] = ulY;
+    psWindow->pucCommand[5] = ulY + ulHeight - 1;
+    psWindow->pucCommand[6] = g_pucRIT128x96x4HorizontalInc[0];
+    psWindow->pucCommand[7] = g_pucRIT128x96x4HorizontalInc[1];
+    psWindow->pucImage = pucImage;
+    psWindow->ulRowBytes = ulWidth / 2;
+    psWindow->ulRows = ulHeight;
+    psWindow->ulStride = ulStride;
+    psWindow->ulSent = 0;
+
+    //
+    // Keep the interrupt out while the queue changes.
+    //
+    SSIIntDisable(SSI0_BASE, SSI_RXFF | SSI_RXTO);
+    g_ulQueueHead++;
+
+    if(!HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE))
+    {
+        //
+        // Start from empty FIFOs, so that the bytes received can be counted.
+        //
+        while(SSIBusy(SSI0_BASE))
+        {
+        }
+        while(SSIDataGetNonBlocking(SSI0_BASE, &ulTemp) != 0)
+        {
+        }
+        g_ulInFlight = 0;
+        HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE) = 1;
+        RITQueueFeed();
+    }
+
+    if(HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE))
+    {
+        SSIIntEnable(SSI0_BASE, SSI_RXFF | SSI_RXTO);
+    }
+
+    return(1);
+}
+
+//*****************************************************************************
+//
+//! Checks whether queued windows are still being drawn.
+//!
+//! \return Returns 1 until the last queued window has been shifted out to the
+//! display, then 0.
+//
+//*****************************************************************************
+unsigned long
+RIT128x96x4QueueBusy(void)
+{
+    return(HWREGBITW(&g_ulSSIFlags, FLAG_QUEUE_ACTIVE));
+}
+
+//*****************************************************************************
+//
+//! Gets the font data for a character.
+//!
+//! \param cChar is the character.
+//!
+//! This function returns the five columns of 1-bit font data used by
+//! RIT128x96x4StringDraw() for a character, so that text can be drawn into an
+//! off-screen frame buffer.  Each byte is a column from left to right, with
+//! the top row in the LSB.  Characters outside of space to tilde get the
+//! font data for a space.
+//!
+//! \return A pointer to the five columns of font data.
+//
+//*****************************************************************************
+const unsigned char *
+RIT128x96x4GlyphGet(char cChar)
+{
+    unsigned char ucTemp;
+
+    ucTemp = cChar & 0x7f;
+    if(ucTemp < ' ')
+    {
+        ucTemp = 0;
+    }
+    else
+    {
+        ucTemp -= ' ';
+    }
+
+    return(g_pucFont[ucTemp]);
+}
+
 //*****************************************************************************
 //
 //! Enable the SSI component of the OLED display driver.
@@ -41,6 +41,22 @@ extern void RIT128x96x4ImageDraw(const unsigned char *pucImage,
                                    unsigned long ulY,
                                    unsigned long ulWidth,
                                    unsigned long ulHeight);
+extern void RIT128x96x4ImageWindowDraw(const unsigned char *pucImage,
+                                         unsigned long ulX,
+                                         unsigned long ulY,
+                                         unsigned long ulWidth,
+                                         unsigned long ulHeight,
+                                         unsigned long ulStride);
+extern void RIT128x96x4IntHandler(void);
+extern void RIT128x96x4QueueInit(void (*pfnCallback)(void));
+extern unsigned long RIT128x96x4ImageWindowQueue(const unsigned char *pucImage,
+                                                 unsigned long ulX,
+                                                 unsigned long ulY,
+                                                 unsigned long ulWidth,
+                                                 unsigned long ulHeight,
+                                                 unsigned long ulStride);
+extern unsigned long RIT128x96x4QueueBusy(void);
+extern const unsigned char *RIT128x96x4GlyphGet(char cChar);
 extern void RIT128x96x4Init(unsigned long ulFrequency);
 extern void RIT128x96x4Enable(unsigned long ulFrequency);
 extern void RIT128x96x4Disable(void);
@@ -53,4 +53,13 @@ void initAdcModule(char adcs);
  */
 _iq getSmoothAdc(char adc, _iq minValue, _iq maxValue);
 
+/**
+ * \brief Gets the uncalibrated ADC reading.
+ *
+ * \param adc The ADC to read.
+ *
+ * \return The 10 bit reading, 0 for bad input.
+ */
+unsigned long getRawAdc(char adc);
+
 #endif
@@ -0,0 +1,111 @@
+/**
+ * \file shared_calibration.h
+ * \brief Common module for calibrating the PWM to ADC links between the boards.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-16
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_CALIBRATION_H
+#define SHARED_CALIBRATION_H
+
+#include "shared_iqmath.h"
+
+#define CALIBRATION_SEGMENTS 16                        /**< Number of linear segments in a calibration table. */
+#define CALIBRATION_POINTS (CALIBRATION_SEGMENTS + 1)  /**< Number of points swept per output. */
+#define CALIBRATION_CHANNELS 3                         /**< Number of ADC inputs that can be calibrated. */
+
+#define CALIBRATION_MSG 'C'                            /**< UART message type marking a settled sweep point. */
+#define CALIBRATION_MSG_LEN 2                          /**< Length of the sweep point frame. */
+
+/**
+ * \brief The value to output at a sweep point.
+ *
+ * \param point The sweep point, 0 to CALIBRATION_POINTS - 1.
+ * \param minValue The 0 duty cycle value of the output.
+ * \param maxValue The maximum duty cycle value of the output.
+ */
+#define CALIBRATION_VALUE(point, minValue, maxValue) \
+	((minValue) + ((maxValue) - (minValue)) / CALIBRATION_SEGMENTS * (point))
+
+/**
+ * \brief Loads the calibration tables from flash.
+ */
+void initCalibration(void);
+
+/**
+ * \brief Starts sweeping the PWM outputs for the other board to calibrate against.
+ */
+void startCalibrationSweep(void);
+
+/**
+ * \brief Advances the calibration sweep, to be called every control or simulation step.
+ *
+ * Sends a CALIBRATION_MSG frame when the current point has settled.
+ *
+ * \return The sweep point to output, -1 if not sweeping.
+ */
+int updateCalibrationSweep(void);
+
+/**
+ * \brief Gets whether a calibration sweep is in progress, for display.
+ *
+ * \return 1 if sweeping, 0 otherwise.
+ */
+int getCalibrationSweeping(void);
+
+/**
+ * \brief Starts or stops a sweep from the GUI.
+ *
+ * \param sweep 1 to start, 0 to abort.
+ */
+void setCalibrationSweeping(int sweep);
+
+/**
+ * \brief Records the ADC readings for a sweep point sent by the other board.
+ *
+ * Called on receiving a CALIBRATION_MSG frame, which initCalibration() registers.
+ *
+ * The tables are rebuilt after the last point and saved to flash by saveCalibration().
+ *
+ * \param point The sweep point the other board is outputting.
+ */
+void recordCalibrationPoint(int point);
+
+/**
+ * \brief Writes a newly recorded table to flash, to be called from the idle hook.
+ *
+ * Every interrupt stalls while flash is written, so the link is paused for the write and bytes
+ * received meanwhile are lost. Each pause is counted in the link stats.
+ */
+void saveCalibration(void);
+
+/**
+ * \brief Corrects a raw ADC reading with the calibration table.
+ *
+ * \param channel The ADC channel index, 0 to CALIBRATION_CHANNELS - 1.
+ * \param raw The raw 10 bit ADC reading.
+ *
+ * \return The corrected 10 bit reading.
+ */
+unsigned long getCalibratedAdc(unsigned int channel, unsigned long raw);
+
+#endif /* SHARED_CALIBRATION_H */
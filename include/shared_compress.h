@@ -0,0 +1,100 @@
+/**
+ * \file shared_compress.h
+ * \brief Common streaming compressor for records of fixed point signal samples.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Each record is the change of every channel since the previous record, zig-zag encoded so small
+ * negative changes are small numbers, then written as a varint of 7 bits per byte (low bits first,
+ * top bit set on all but the last byte).
+ *
+ * In run-length mode each varint also carries a flag in its lowest bit: 0 for a change, 1 for a run
+ * of channels that did not change, the rest of the value being the run length less one.
+ *
+ * A record is self contained given the previous record, so records can be framed and sent one at a
+ * time. The module has no target dependencies so the host tools use it too.
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_COMPRESS_H
+#define SHARED_COMPRESS_H
+
+#include <stdint.h>
+
+#define COMPRESS_MAX_CHANNELS 8
+#define COMPRESS_MAX_VARINT 5                                      /**< Bytes needed for a 32 bit varint. */
+#define COMPRESS_MAX_RECORD (COMPRESS_MAX_CHANNELS * COMPRESS_MAX_VARINT) /**< Worst case compressed record. */
+
+/**
+ * \struct Compressor
+ *
+ * \brief Holds the state of one end of a compressed stream, compressing or decompressing.
+ */
+typedef struct
+{
+	unsigned int channels;                 /**< Number of values in a record. */
+	int runLength;                         /**< Whether unchanged channels are run-length encoded. */
+	int32_t last[COMPRESS_MAX_CHANNELS];   /**< Values of the previous record. */
+} Compressor;
+
+/**
+ * \brief Initialises a compressor or decompressor with all previous values 0
+ * \public \memberof Compressor
+ *
+ * \param compressor The compressor
+ * \param channels Number of values in a record, at most COMPRESS_MAX_CHANNELS
+ * \param runLength 1 to run-length encode unchanged channels
+ */
+void compressorInit(Compressor *compressor, unsigned int channels, int runLength);
+
+/**
+ * \brief Sets the previous values, for example from an uncompressed key record
+ * \public \memberof Compressor
+ *
+ * \param compressor The compressor
+ * \param values The values
+ */
+void compressorSetLast(Compressor *compressor, const int32_t *values);
+
+/**
+ * \brief Compresses a record against the previous one
+ * \public \memberof Compressor
+ *
+ * \param compressor The compressor
+ * \param values The record, compressor->channels values
+ * \param out Buffer of at least COMPRESS_MAX_RECORD bytes
+ * \return Number of bytes written
+ */
+unsigned int compressRecord(Compressor *compressor, const int32_t *values, unsigned char *out);
+
+/**
+ * \brief Decompresses a record
+ * \public \memberof Compressor
+ *
+ * \param compressor The decompressor, initialised the same as the compressor
+ * \param in The compressed bytes
+ * \param length Number of compressed bytes available
+ * \param values Where to write the record, compressor->channels values
+ * \return Number of bytes consumed, 0 if the input is truncated or malformed
+ */
+unsigned int decompressRecord(Compressor *compressor, const unsigned char *in, unsigned int length, int32_t *values);
+
+#endif
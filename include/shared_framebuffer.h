@@ -0,0 +1,123 @@
+/**
+ * \file shared_framebuffer.h
+ * \brief Declares an off-screen copy of the OLED display that is flushed to it in dirty rectangles
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Drawing functions mirror the RIT128x96x4 driver but only write to RAM, noting the span of bytes
+ * that changed in each row and in each column. framebufferFlush() then sends just the changed
+ * rectangles to the display, along rows or down columns whichever is cheaper, so a view can be
+ * cleared and redrawn in full without the display flickering or the unchanged parts being sent
+ * again.
+ *
+ * Flushes are sent from the SSI interrupt, so the drawing task blocks rather than spins while the
+ * display catches up. Not thread safe, only the GUI task draws.
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_FRAMEBUFFER_H
+#define SHARED_FRAMEBUFFER_H
+
+#define FRAMEBUFFER_WIDTH 128                         /**<pixels across the display */
+#define FRAMEBUFFER_HEIGHT 96                         /**<pixels down the display */
+#define FRAMEBUFFER_STRIDE (FRAMEBUFFER_WIDTH / 2)    /**<bytes in a row, two 4 bit pixels a byte */
+#define FRAMEBUFFER_GLYPH_HEIGHT 8                    /**<rows written by each character, as the driver does */
+#define FRAMEBUFFER_GLYPH_WIDTH 6                     /**<columns written by each character, as the driver does */
+#define FRAMEBUFFER_CACHED_LEVELS 2                   /**<brightnesses text can be drawn at from pre-expanded glyphs */
+
+/**
+ * \brief Sets up flushes to be sent from the SSI interrupt
+ *
+ * Call once after RIT128x96x4Init(), before the first flush. Without it flushes are sent by
+ * polling the SSI as the driver's drawing functions do.
+ *
+ * \return 0 on success, -1 if the completion semaphore could not be created
+ */
+int framebufferInit(void);
+
+/**
+ * \brief Blocks until the last flush has been sent, as the display is sent from the frame itself
+ *
+ * Call before drawing into the frame again.
+ */
+void framebufferWait(void);
+
+/**
+ * \brief Turns every pixel off
+ */
+void framebufferClear(void);
+
+/**
+ * \brief Expands the font for a brightness once, so text drawn at it is copied rather than built
+ * up a pixel at a time
+ *
+ * \param level Brightness of the lit pixels, 0 to 15
+ * \return 0 on success, -1 if FRAMEBUFFER_CACHED_LEVELS brightnesses are already cached
+ */
+int framebufferCacheLevel(unsigned char level);
+
+/**
+ * \brief Draws a string, lighting its pixels and turning off the rest of each character cell
+ *
+ * Like RIT128x96x4StringDraw, x is rounded down to an even column and characters past the right
+ * edge are left out.
+ *
+ * \param str String to draw
+ * \param x Column of the left of the string
+ * \param y Row of the top of the string
+ * \param level Brightness of the lit pixels, 0 to 15
+ */
+void framebufferStringDraw(const char *str, unsigned int x, unsigned int y, unsigned char level);
+
+/**
+ * \brief Draws an image laid out as for RIT128x96x4ImageDraw
+ *
+ * \param image Rows of width / 2 bytes, the left pixel of each byte in the high nibble
+ * \param x Column of the left of the image, even
+ * \param y Row of the top of the image
+ * \param width Columns in the image, even
+ * \param height Rows in the image
+ */
+void framebufferImageDraw(const unsigned char *image, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+/**
+ * \brief Moves a region left, turning off the pixels it uncovers
+ *
+ * \param x Column of the left of the region, even
+ * \param y Row of the top of the region
+ * \param width Columns in the region, even
+ * \param height Rows in the region
+ * \param distance Columns to move by, even
+ */
+void framebufferScroll(unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int distance);
+
+/**
+ * \brief Sends the parts of the frame buffer that changed since the last flush to the display
+ *
+ * The changes are covered by windows along rows or down columns, whichever costs less. Neighbouring
+ * rows or columns are sent together while that costs less than starting a new window. Returns once
+ * the windows are queued, see framebufferWait().
+ *
+ * \return Number of bytes sent to the display, commands included
+ */
+unsigned int framebufferFlush(void);
+
+#endif
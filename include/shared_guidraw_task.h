@@ -53,4 +53,11 @@ int queueInputEvent(Button button, ButtonEvent event);
  */
 void vGuiRefreshTask(void *pvParameters);
 
+/**
+ * \brief Gets the bytes sent to the display over SSI in the last second, for display
+ *
+ * \return Bytes sent, commands included
+ */
+int getDisplayBytesPerSecond(void);
+
 #endif
@@ -28,10 +28,10 @@
 #ifndef UI_TASK_H_
 #define UI_TASK_H_
 
-#include "shared_tracenode.h"
+#include "shared_tracebuffer.h"
 #include "inc/hw_types.h"
 
-#define ACTIVITY_MAX_PAGES 5    /**<maximum number of pages in a GUI */
+#define ACTIVITY_MAX_PAGES 8    /**<maximum number of pages in a GUI */
 
 #define LISTVIEW_MAX_ITEMS 7    /**<maximum number of items allowed in a ListView */
 
@@ -43,6 +43,7 @@
 #define TRACEVIEW_POINTS 64     /**<number of data points to store in TraceView menu */
 #define TRACE_ZERO_CENTER -1    /**<specifies the zero height of the TraceView to be center */
 #define TRACE_ZERO_DYNAMIC -2   /**<specifies the center value of the TraceView to always be the value of the rightmost point */
+#define TRACE_CHANNEL_BRIGHTNESS {15, 9, 5, 3} /**<default brightness of each channel of a selected TraceView, dimmer channels drawn under brighter */
 
 
 /**
@@ -115,13 +116,14 @@ typedef struct
 typedef struct
 {
 	char name[VIEW_NAME_SIZE];            /**<name of the view*/
-	CircularBufferHandler *buffer;        /**<pointer to circular buffer handler*/
+	CompactTraceBuffer *buffer;           /**<pointer to the trace buffer to draw*/
 
 	unsigned int zeroLine;                /**<position on screen representing y value of 0*/
 	tBoolean dynamicZero;                 /**<sets trace to always set center point to be the rightmost point*/
-	unsigned int minZoomHorzScale;        /**<change in horizontal trace position in pixels per change in x value of TraceNode while zoomed out*/
-	unsigned int maxZoomHorzScale;        /**<change in horizontal trace position in pixels per change in x value of TraceNode while zoomed in*/
-	int vertScale;                        /**<change in vertical trace position in CHAR_HEIGHT per change in y value of TraceNode*/
+	unsigned int minZoomHorzScale;        /**<change in horizontal trace position in pixels per change in x value of a trace sample while zoomed out*/
+	unsigned int maxZoomHorzScale;        /**<change in horizontal trace position in pixels per change in x value of a trace sample while zoomed in*/
+	int vertScale;                        /**<change in vertical trace position in CHAR_HEIGHT per change in y value of a trace sample*/
+	char channelBrightness[TRACE_MAX_CHANNELS]; /**<brightness of each channel while selected, scaled down while not*/
 	unsigned int horzScaleStep;           /**<change in dispHorzScale with every button press*/
 	unsigned int dispHorzScale;           /**<horizontal scale the trace is currently drawn at*/
 } TraceView;
@@ -173,14 +175,16 @@ ListView listView(char *name, unsigned int numItems);
 /**
  * \brief Constructs a TraceView with compulsory values as set and context initialized
  *
+ * Every channel of the buffer is overlaid, the first brightest and on top of the others.
+ *
  * \param name Label of the view
- * \param buffer Pointer to the handler of the circular buffer to draw
+ * \param buffer Pointer to the trace buffer to draw
  * \param zeroHeight Pixel height the value 0 from bottom of trace plot
- * \param minHorzScale Change in horizontal trace position in pixels per x value of TraceNode while zoomed out
- * \param maxHorzScale Change in horizontal trace position in pixels per x value of TraceNode while zoomed in
- * \param vertScale Change in vertical trace position in CHAR_HEIGHT per y value of TraceNode
+ * \param minHorzScale Change in horizontal trace position in pixels per x value of a trace sample while zoomed out
+ * \param maxHorzScale Change in horizontal trace position in pixels per x value of a trace sample while zoomed in
+ * \param vertScale Change in vertical trace position in CHAR_HEIGHT per y value of a trace sample
  */
-TraceView traceView(char *name, CircularBufferHandler *buffer, int zeroHeight, unsigned int minHorzScale, unsigned int maxHorzScale, int vertScale);
+TraceView traceView(char *name, CompactTraceBuffer *buffer, int zeroHeight, unsigned int minHorzScale, unsigned int maxHorzScale, int vertScale);
 
 /**
  * \brief Constructs an Activity with compulsory values set set and context initialized
@@ -0,0 +1,168 @@
+/**
+ * \file shared_link_stats.h
+ * \brief Common module counting link errors and measuring round trip times between the boards.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_LINK_STATS_H
+#define SHARED_LINK_STATS_H
+
+#define LINK_RTT_BINS 7        /**< Number of round trip time histogram bins, the last one catches the rest. */
+#define LINK_RTT_BIN_TICKS 1   /**< Width of a histogram bin in RTOS ticks. */
+
+/**
+ * \brief Counts a frame that could not be queued because the transmit pool was exhausted.
+ */
+void linkStatsTxDrop(void);
+
+/**
+ * \brief Records the number of transmit frame buffers in use after a claim, tracking the peak.
+ *
+ * \param inUse Number of frame buffers claimed or waiting to be sent
+ */
+void linkStatsPoolUsage(unsigned long inUse);
+
+/**
+ * \brief Counts a binary frame that failed its CRC check.
+ */
+void linkStatsCrcError(void);
+
+/**
+ * \brief Counts the decoder losing frame alignment and hunting for the next frame.
+ */
+void linkStatsResync(void);
+
+/**
+ * \brief Counts a received byte discarded because the receive ring was full, called from the UART ISR.
+ */
+void linkStatsRxOverrun(void);
+
+/**
+ * \brief Counts the link being paused for a flash write, during which received bytes are lost.
+ */
+void linkStatsFlashPause(void);
+
+/**
+ * \brief Records an echoed sequence number and timestamp, updating lost echoes and the round trip histogram.
+ *
+ * \param sequence The sequence number of the echoed frame
+ * \param timestamp The timestamp the echoed frame was sent with
+ */
+void linkStatsEcho(unsigned char sequence, unsigned short timestamp);
+
+/**
+ * \brief Gets the timestamp to stamp frames with.
+ *
+ * \return The low 16 bits of the RTOS tick count
+ */
+unsigned short getLinkTimestamp(void);
+
+/**
+ * \brief Gets whether frames are being sent with sequence numbers and timestamps.
+ *
+ * \return 1 if frames are stamped, 0 otherwise
+ */
+int getLinkStamps(void);
+
+/**
+ * \brief Sets whether frames are sent with sequence numbers and timestamps.
+ *
+ * \param stamps 1 to stamp frames, 0 otherwise
+ */
+void setLinkStamps(int stamps);
+
+/**
+ * \brief Gets the number of frames dropped because the transmit pool was exhausted.
+ *
+ * \return The number of dropped frames
+ */
+int getLinkTxDrops(void);
+
+/**
+ * \brief Gets the most transmit frame buffers that have been in use at once.
+ *
+ * \return The peak number of frame buffers in use
+ */
+int getLinkPoolPeak(void);
+
+/**
+ * \brief Gets the number of frames rejected by the CRC check.
+ *
+ * \return The number of CRC errors
+ */
+int getLinkCrcErrors(void);
+
+/**
+ * \brief Gets the number of times the decoder lost frame alignment.
+ *
+ * \return The number of resyncs
+ */
+int getLinkResyncs(void);
+
+/**
+ * \brief Gets the number of received bytes discarded because the receive ring was full.
+ *
+ * \return The number of overrun bytes
+ */
+int getLinkRxOverruns(void);
+
+/**
+ * \brief Gets the number of times the link was paused for a flash write.
+ *
+ * \return The number of flash pauses
+ */
+int getLinkFlashPauses(void);
+
+/**
+ * \brief Gets the number of stamped frames whose echo never arrived.
+ *
+ * \return The number of lost echoes
+ */
+int getLinkLostEchoes(void);
+
+/**
+ * \brief Gets the count of a round trip time histogram bin.
+ *
+ * \param bin The bin, 0 to LINK_RTT_BINS - 1
+ * \return The number of round trips falling in the bin
+ */
+int getLinkRttCount(unsigned int bin);
+
+int getLinkRtt0(void); /**< \brief Gets the count of round trips within 1 bin width. */
+int getLinkRtt1(void); /**< \brief Gets the count of round trips within 2 bin widths. */
+int getLinkRtt2(void); /**< \brief Gets the count of round trips within 3 bin widths. */
+int getLinkRtt3(void); /**< \brief Gets the count of round trips within 4 bin widths. */
+int getLinkRtt4(void); /**< \brief Gets the count of round trips within 5 bin widths. */
+int getLinkRtt5(void); /**< \brief Gets the count of round trips within 6 bin widths. */
+int getLinkRtt6(void); /**< \brief Gets the count of slower round trips. */
+
+/**
+ * \brief Function of the link debug task to be called by the FreeRTOS kernel
+ *
+ * Periodically prints the link counters and round trip histogram on the debug UART (UART0).
+ *
+ * \param pvParameters		Unused
+ */
+void vLinkDebugTask(void *pvParameters);
+
+#endif
@@ -35,6 +35,14 @@
 #define ACTUATOR_FORCE_PWM 0x01  /**< The actuator force PWM. */
 #define DAMPING_COEFF_PWM 0x02   /**< The damping coefficient PWM. */
 
+#define PWM_NUM_OUTS 3           /**< The number of PWM outputs, the size of the setDutyBatch() array. */
+
+#define ACC_SPRUNG_PWM_INDEX 0       /**< The sprung acceleration index for setDutyBatch(). */
+#define ACC_UNSPRUNG_PWM_INDEX 1     /**< The unsprung acceleration index for setDutyBatch(). */
+#define COIL_EXTENSION_PWM_INDEX 2   /**< The coil extension index for setDutyBatch(). */
+#define ACTUATOR_FORCE_PWM_INDEX 0   /**< The actuator force index for setDutyBatch(). */
+#define DAMPING_COEFF_PWM_INDEX 1    /**< The damping coefficient index for setDutyBatch(). */
+
 /**
  * \brief Initailises the PWM module.
  *
@@ -52,4 +60,34 @@ void initPwmModule(char pwmOuts);
  */
 void setDuty(char pwmPin, _iq value, _iq minValue, _iq maxValue);
 
+/**
+ * \brief Sets the value range of a PWM output and precomputes its duty scale.
+ *
+ * \param pwmPin The PWM output of which to set.
+ * \param minValue The value giving a 0 duty cycle.
+ * \param maxValue The value giving the maximum duty cycle.
+ */
+void setPwmRange(char pwmPin, _iq minValue, _iq maxValue);
+
+/**
+ * \brief Sets the duty cycle of all enabled PWM outputs, latched on the same PWM period.
+ *
+ * Outputs must have had their range set with setPwmRange() first.
+ *
+ * \param values The value for each output, indexed by the *_PWM_INDEX defines.
+ */
+void setDutyBatch(const _iq values[PWM_NUM_OUTS]);
+
+/**
+ * \brief Enables or disables sigma-delta dithering of a PWM output.
+ *
+ * While enabled the pulse width is rewritten DITHER_RATE_HZ times a second from a timer
+ * interrupt, carrying the fractional remainder across updates for extra effective resolution
+ * after the RC filter.
+ *
+ * \param pwmPin The PWM output of which to set.
+ * \param enable 1 to dither, 0 for a fixed pulse width.
+ */
+void setPwmDither(char pwmPin, int enable);
+
 #endif
@@ -0,0 +1,255 @@
+/**
+ * \file shared_tracebuffer.h
+ * \brief Declares a compact circular buffer of trace samples, addressed by index rather than pointers
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Each sample keeps a 16 bit y for each channel and the change in x since the previous sample as
+ * a byte, in units given when the buffer is created. That is 3 bytes a sample for one channel
+ * against the 16 of a TraceNode. x is only known relative to the latest sample, which is all a
+ * trace needs to plot. Channels share x and are written together, a row of values a sample.
+ *
+ * Summary levels can be added to the buffer for plotting zoomed out. Each level keeps the minimum
+ * and maximum y of buckets of x twice as wide as the level before, updated as samples are written,
+ * so a plot can draw each column from one or two buckets without losing short spikes.
+ *
+ * Safe for one writing task and any number of tasks walking back through the samples, without
+ * locks. The writer publishes a sample by storing its index after the sample is complete. The
+ * latest bucket of a level is updated in place, so a reader may see it part way through an update.
+ * Where the latest bucket is, and its x, are read together by retrying if a write came in between.
+ *
+ * A buffer can be armed to capture around a trigger like an oscilloscope. Once it has the samples
+ * wanted before the trigger, the writer marks the latest sample as the trigger when its condition
+ * holds, keeps writing the samples wanted after it, then ignores writes until armed again.
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_TRACEBUFFER_H
+#define SHARED_TRACEBUFFER_H
+
+#define TRACE_MAX_DELTA 255         /**<largest change in x a sample can store, in x units */
+#define TRACE_MAX_LEVELS 6          /**<most levels a buffer can have, including the samples themselves */
+#define TRACE_MAX_CHANNELS 4        /**<most values a buffer can keep for each sample */
+
+/**
+ * \struct TraceLevel
+ *
+ * \brief Circular buffer of the y range of each bucket of x at one level of a trace buffer
+ *
+ * min and max hold a row of a value for each channel a bucket. At level 0 each bucket is a sample
+ * and min and max are the same array.
+ */
+typedef struct
+{
+	short *min;                         /**<lowest y of each channel in each bucket */
+	short *max;                         /**<highest y of each channel in each bucket */
+	unsigned int channels;              /**<number of values in each row */
+	unsigned char *dx;                  /**<change in x from the previous bucket to each bucket, in buckets */
+	unsigned int size;                  /**<number of buckets in this level */
+	unsigned int shift;                 /**<buckets are 2 to the power of shift x units wide */
+	unsigned int fill;                  /**<x units written into the latest bucket */
+	volatile unsigned int lastWritten;  /**<index of the bucket that was last written */
+	volatile unsigned int used;         /**<number of buckets written, up to size */
+} TraceLevel;
+
+/**
+ * \enum TraceTriggerState
+ *
+ * \brief Progress of a capture around a trigger
+ */
+typedef enum
+{
+	TRIGGER_IDLE,                       /**<not capturing, samples are written as they come */
+	TRIGGER_ARMED,                      /**<keeping samples until the trigger */
+	TRIGGER_TRIGGERED,                  /**<keeping the samples after the trigger */
+	TRIGGER_FROZEN                      /**<capture complete, writes are ignored */
+} TraceTriggerState;
+
+/**
+ * \struct TraceTrigger
+ *
+ * \brief Holds the settings and progress of a capture around a trigger
+ */
+typedef struct
+{
+	volatile TraceTriggerState state;   /**<progress of the capture */
+	unsigned int pre;                   /**<samples to keep before the trigger */
+	unsigned int post;                  /**<samples to keep after the trigger */
+	unsigned int count;                 /**<samples written since arming while armed, still to write while triggered */
+	unsigned int index;                 /**<index of the trigger sample */
+	int x;                              /**<lastX of the buffer when it triggered */
+} TraceTrigger;
+
+/**
+ * \struct CompactTraceBuffer
+ *
+ * \brief Handler for compact trace buffers
+ */
+typedef struct
+{
+	TraceLevel levels[TRACE_MAX_LEVELS]; /**<the samples followed by the summary levels */
+	unsigned int numLevels;             /**<number of levels including the samples */
+	int xUnit;                          /**<change in x represented by a dx of 1 */
+	int lastX;                          /**<x of the latest sample as stored, so rounding does not accumulate */
+	TraceTrigger trigger;               /**<capture around a trigger, idle unless armed */
+	volatile unsigned int writes;       /**<incremented before and after each write, odd while one is part way through */
+} CompactTraceBuffer;
+
+/**
+ * \struct TraceCursor
+ *
+ * \brief Position of a walk back through one level of a compact trace buffer from the latest bucket
+ */
+typedef struct
+{
+	const TraceLevel *level;            /**<level being walked */
+	int bucketX;                        /**<width of a bucket in x */
+	unsigned int index;                 /**<index of the current bucket */
+	unsigned int remaining;             /**<buckets older than the current one which are still valid */
+	int x;                              /**<x of the start of the current bucket relative to the latest sample */
+	int latestX;                        /**<x of the latest sample when the walk started */
+	const short *min;                   /**<lowest y of each channel in the current bucket */
+	const short *max;                   /**<highest y of each channel in the current bucket */
+} TraceCursor;
+
+/**
+ * \brief Creates a compact trace buffer from arrays of samples
+ * \public \memberof CompactTraceBuffer
+ *
+ * \param y Array of size rows of channels y values
+ * \param dx Array of size x changes
+ * \param size Number of samples in the buffer, at least 2
+ * \param channels Number of values in each sample, at most TRACE_MAX_CHANNELS
+ * \param xUnit Change in x represented by a dx of 1
+ * \return Handler for the buffer
+ */
+CompactTraceBuffer createCompactTraceBuffer(short *y, unsigned char *dx, unsigned int size, unsigned int channels, int xUnit);
+
+/**
+ * \brief Adds a summary level with buckets twice as wide as the last level
+ * \public \memberof CompactTraceBuffer
+ *
+ * Must be called before anything is written. A level needs enough buckets to cover the width of a plot
+ * at the zoom it is used for, a few more than twice the number of plot columns is always enough.
+ *
+ * \param buffer The buffer
+ * \param min Array of size rows of channels lowest y values
+ * \param max Array of size rows of channels highest y values
+ * \param dx Array of size x changes
+ * \param size Number of buckets in the level, at least 2
+ * \return 0 for success, -1 if the buffer already has TRACE_MAX_LEVELS levels
+ */
+int compactTraceAddLevel(CompactTraceBuffer *buffer, short *min, short *max, unsigned char *dx, unsigned int size);
+
+/**
+ * \brief Chooses the level to plot with
+ * \public \memberof CompactTraceBuffer
+ *
+ * \param buffer The buffer
+ * \param columnX Change in x across one column of the plot
+ * \return The coarsest level whose buckets are no wider than a column
+ */
+unsigned int compactTraceLevelFor(const CompactTraceBuffer *buffer, int columnX);
+
+/**
+ * \brief Writes a sample over the oldest sample
+ * \public \memberof CompactTraceBuffer
+ *
+ * Must only be called from one task, never waits. y is limited to 16 bits. Changes in x of more than
+ * TRACE_MAX_DELTA units are stored as TRACE_MAX_DELTA, the rest being carried into the next sample.
+ *
+ * \param buffer The buffer
+ * \param x value to write
+ * \param y values to write, one for each channel
+ */
+void compactTraceWrite(CompactTraceBuffer *buffer, int x, const int *y);
+
+/**
+ * \brief Starts a capture around a trigger, dropping any frozen capture
+ * \public \memberof CompactTraceBuffer
+ *
+ * Must only be called from the writing task. Triggers are ignored until the trigger sample and the pre
+ * before it have been written since arming, so every capture is pre + 1 + post samples long with the trigger sample pre from the start.
+ *
+ * \param buffer The buffer
+ * \param pre Samples to keep before the trigger
+ * \param post Samples to keep after the trigger
+ * \return 0 for success, -1 if pre + post + 2 is more than the size of the buffer
+ */
+int compactTraceArm(CompactTraceBuffer *buffer, unsigned int pre, unsigned int post);
+
+/**
+ * \brief Stops capturing and lets writes through again
+ * \public \memberof CompactTraceBuffer
+ *
+ * Must only be called from the writing task.
+ *
+ * \param buffer The buffer
+ */
+void compactTraceDisarm(CompactTraceBuffer *buffer);
+
+/**
+ * \brief Marks the latest sample as the trigger if the buffer is armed and has its pre trigger samples
+ * \public \memberof CompactTraceBuffer
+ *
+ * Must only be called from the writing task, after writing the sample the condition was evaluated for.
+ * Costs a comparison or two, so the condition can be checked every sample.
+ *
+ * \param buffer The buffer
+ * \return 0 if it triggered, -1 otherwise
+ */
+int compactTraceTrigger(CompactTraceBuffer *buffer);
+
+/**
+ * \brief Reads a sample of a frozen capture
+ * \public \memberof CompactTraceBuffer
+ *
+ * \param buffer The buffer
+ * \param offset Position of the sample relative to the trigger, from -pre to post
+ * \param row Set to the value of each channel of the sample
+ * \param dx Set to the change in x from the previous sample
+ * \return 0 for success, -1 if the capture is not frozen or offset is outside it
+ */
+int compactTraceCaptureRow(const CompactTraceBuffer *buffer, int offset, const short **row, int *dx);
+
+/**
+ * \brief Starts a walk back through a level of the buffer at the latest bucket
+ * \public \memberof TraceCursor
+ *
+ * \param cursor The cursor to start
+ * \param buffer The buffer to walk
+ * \param level The level to walk, 0 for the samples themselves
+ * \return 0 for success, -1 if the level is empty or does not exist
+ */
+int traceCursorLatest(TraceCursor *cursor, const CompactTraceBuffer *buffer, unsigned int level);
+
+/**
+ * \brief Moves the cursor back to the previous bucket
+ * \public \memberof TraceCursor
+ *
+ * Stops short of buckets the writer could be overwriting.
+ *
+ * \param cursor The cursor
+ * \return 0 for success, -1 if there is no older valid bucket
+ */
+int traceCursorPrev(TraceCursor *cursor);
+
+#endif
@@ -0,0 +1,213 @@
+/**
+ * \file shared_uart_frame.h
+ * \brief Common encoder and decoder of the frames sent between the boards.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * ASCII frames are the type character followed by a payload whose length is fixed by the type.
+ * Binary frames are wrapped as sync byte, type, payload, then the CRC-16 of the type and payload,
+ * low byte first. A CRC-8 let about one in 256 misframed or corrupted frames through, too many
+ * on a link that resynchronises on any sync byte.
+ *
+ * The module has no target dependencies so the host tools use it too. Each end of a link keeps
+ * its own registry and decoder.
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef SHARED_UARTFRAME_H
+#define SHARED_UARTFRAME_H
+
+#define UART_FRAME_SIZE 8
+#define UART_MSG_TYPES 256       /**< One index entry per type character */
+#define UART_MAX_MSG_TYPES 16    /**< Types one end of the link can register */
+#define UART_SYNC_BYTE 0xA5      /**< Starts a binary frame: sync, type, payload, CRC-16 of type and payload */
+#define UART_CRC_BYTES 2         /**< Bytes of CRC after a binary frame */
+#define UART_MAX_ENCODED (UART_FRAME_SIZE + 2 + UART_CRC_BYTES) /**< Longest encoded frame, a full binary frame */
+
+/**
+ * \struct _UartFrame
+ * \brief Structure of the UART message
+ */
+typedef struct
+{
+	char msgType;
+	char msg[UART_FRAME_SIZE];
+} _UartFrame;
+
+/**
+ * \union UartFrame
+ * \brief Allows UART message to be accessed with structure or as a bit stream
+ */
+typedef union
+{
+	_UartFrame frameWise;                   /**< Allows access with structure */
+	unsigned char byteWise[UART_FRAME_SIZE + 1]; /**< Allows access as a byte stream */
+} UartFrame;
+
+/**
+ * \brief Function type of callbacks for this module
+ */
+typedef void (*uartCallback)(UartFrame *);
+
+/**
+ * \brief A registered message type
+ */
+typedef struct
+{
+	unsigned char length;  /**< Length of the frame including the type character, 0 if unregistered */
+	unsigned char binaryOnly; /**< Set if frames of this type are only accepted with a sync byte and CRC */
+	uartCallback handler;  /**< Called with received frames of this type, NULL for send only types */
+} MsgType;
+
+/**
+ * \struct FrameRegistry
+ * \brief The message types known to one end of the link
+ *
+ * Types are looked up through a byte per type character, so the handlers only take space for
+ * the types registered. A zeroed registry has no types.
+ */
+typedef struct
+{
+	unsigned char index[UART_MSG_TYPES];  /**< One more than the position of each type in types, 0 if unregistered */
+	unsigned char count;                  /**< Types registered */
+	MsgType types[UART_MAX_MSG_TYPES];
+} FrameRegistry;
+
+/**
+ * \brief States of the binary frame decoder, ASCII frames are decoded from DECODE_IDLE
+ */
+typedef enum
+{
+	DECODE_IDLE,    /**< Waiting for a sync byte or an ASCII message type */
+	DECODE_TYPE,    /**< Sync byte received, waiting for the message type */
+	DECODE_PAYLOAD, /**< Receiving the payload of a binary frame */
+	DECODE_CRC,     /**< Waiting for the low byte of the CRC of a binary frame */
+	DECODE_CRC_HIGH /**< Waiting for the high byte of the CRC of a binary frame */
+} DecodeState;
+
+/**
+ * \brief What a byte fed to the decoder did
+ */
+typedef enum
+{
+	DECODE_NONE,      /**< The byte was consumed, no frame is complete yet */
+	DECODE_FRAME,     /**< A frame is complete and held by the decoder */
+	DECODE_CRC_ERROR, /**< A binary frame was dropped for failing its CRC */
+	DECODE_RESYNC     /**< The decoder lost the frame boundaries and started hunting for a frame */
+} DecodeResult;
+
+/**
+ * \struct FrameDecoder
+ * \brief Holds the state of the decoder for one end of the link
+ */
+typedef struct
+{
+	const FrameRegistry *registry; /**< Types the decoder accepts */
+	DecodeState state;
+	unsigned int index;            /**< Bytes of frame received */
+	unsigned int msgLen;           /**< Length of the frame being received */
+	unsigned char crcLow;          /**< Low byte of the CRC received */
+	int hunting;                   /**< Set while discarding bytes between frames */
+	UartFrame frame;               /**< The frame being received, complete after DECODE_FRAME */
+} FrameDecoder;
+
+/**
+ * \brief Registers a message type, giving its frame length and the handler for received frames
+ * \public \memberof FrameRegistry
+ *
+ * \param registry The registry
+ * \param type Type character of the message
+ * \param length Length of the frame including the type character
+ * \param binaryOnly 1 if frames of this type are only sent in binary frames, so an ASCII frame of it
+ * can only be a payload byte or a corrupted frame and is not accepted
+ * \param handler Callback to execute for received frames of this type, or NULL
+ * \return 0 for success, -1 if the length does not fit in a UartFrame, the type is the sync byte
+ *         or UART_MAX_MSG_TYPES types are already registered
+ */
+int registerFrameType(FrameRegistry *registry, char type, unsigned int length, int binaryOnly, uartCallback handler);
+
+/**
+ * \brief Gets the length of a message type
+ * \public \memberof FrameRegistry
+ *
+ * \param registry The registry
+ * \param type Char representing message type
+ * \return Length of frame including the type character, 0 if the type is not registered
+ */
+unsigned int getFrameLength(const FrameRegistry *registry, char type);
+
+/**
+ * \brief Passes a received frame to the handler registered for its type
+ * \public \memberof FrameRegistry
+ *
+ * \param registry The registry
+ * \param uartFrame The received frame
+ */
+void dispatchFrame(const FrameRegistry *registry, UartFrame *uartFrame);
+
+/**
+ * \brief Calculates the CRC sent after a binary frame
+ *
+ * \param uartFrame The frame
+ * \param length Length of the frame including the type character
+ * \return The CRC-16 of the type and payload
+ */
+unsigned short getFrameCrc(const UartFrame *uartFrame, unsigned int length);
+
+/**
+ * \brief Encodes a frame into the bytes sent on the line
+ *
+ * \param uartFrame The frame
+ * \param length Length of the frame including the type character
+ * \param binary 1 to wrap the frame with a sync byte and CRC
+ * \param encoded Buffer of at least UART_MAX_ENCODED bytes
+ * \return Number of bytes encoded
+ */
+unsigned int encodeFrame(const UartFrame *uartFrame, unsigned int length, int binary, unsigned char *encoded);
+
+/**
+ * \brief Initialises a decoder
+ * \public \memberof FrameDecoder
+ *
+ * \param decoder The decoder
+ * \param registry Types the decoder accepts, kept by reference
+ */
+void frameDecoderInit(FrameDecoder *decoder, const FrameRegistry *registry);
+
+/**
+ * \brief Discards anything half received, for example after the line rate changes
+ * \public \memberof FrameDecoder
+ *
+ * \param decoder The decoder
+ */
+void frameDecoderReset(FrameDecoder *decoder);
+
+/**
+ * \brief Feeds one received byte through the decoder
+ * \public \memberof FrameDecoder
+ *
+ * \param decoder The decoder
+ * \param receivedChar The byte received
+ * \return DECODE_FRAME when decoder->frame holds a complete frame
+ */
+DecodeResult decodeFrameByte(FrameDecoder *decoder, unsigned char receivedChar);
+
+#endif
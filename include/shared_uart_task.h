@@ -27,59 +27,147 @@
 #ifndef SHARED_UARTTASK_H
 #define SHARED_UARTTASK_H
 
-#define UART_FRAME_SIZE 6
+#include "shared_uart_frame.h"
+
+#define UART_BAUD 625000         /**< Base rate, used until negotiation finds a faster one */
+
+#define UART_BINARY_FRAC_BITS 8  /**< Fractional bits of fixed point values in binary payloads */
+
+#define THROTTLE_BINARY_MSG 'a'  /**< Throttle as a little endian signed fixed point short */
+#define THROTTLE_BINARY_LEN 3
+#define ROAD_BINARY_MSG 'r'      /**< Road type as a single byte */
+#define ROAD_BINARY_LEN 2
+#define CONTROL_BINARY_MSG 'K'   /**< Throttle short, road type, control flags and ASC status coalesced */
+#define CONTROL_BINARY_LEN 6
+#define STAMPED_CONTROL_BINARY_MSG 'k' /**< Control frame followed by a sequence number and 16 bit timestamp */
+#define STAMPED_CONTROL_BINARY_LEN 9
+#define STAMPED_STATUS_BINARY_MSG 'w'  /**< WUS status followed by the echoed sequence number and timestamp */
+#define STAMPED_STATUS_BINARY_LEN 5
+
+#define NEGOTIATE_REQUEST_MSG 'N' /**< Master asking the slave to try a candidate rate */
+#define NEGOTIATE_ACK_MSG 'n'     /**< Slave switching to the candidate rate */
+#define NEGOTIATE_COMMIT_MSG 'Y'  /**< Master keeping the candidate rate after the loopback test passed */
+#define NEGOTIATE_MSG_LEN 2       /**< Negotiation frames carry the candidate index */
+
+#define UART_BAUD_CANDIDATES 5    /**< Rates tried fastest first, all exact divisions of the 50MHz clock */
+#define UART_BAUD_CANDIDATE_LIST {3125000, 2500000, 1562500, 1250000, 1000000}
+#define NEGOTIATE_LOOPBACK_BYTES 64 /**< Length of the test pattern echoed at each candidate rate */
+#define NEGOTIATE_PATTERN(i) ((unsigned char)((i) * 167 + 0x55)) /**< Test pattern byte, varies every bit */
+
+#define RESET_MSG_LEN 1          /**< Length of the 'S' reset frame */
+#define ASC_STATUS_MSG_LEN 2     /**< Length of the 'M' ASC status frame */
+#define WUS_STATUS_MSG_LEN 2     /**< Length of the 'W' WUS status frame */
+
+#define CONTROL_RESET_FLAG 0x01  /**< Control flag requesting the simulation be reset */
 
 /**
- * \struct _UartFrame
- * \brief Structure of the UART message
+ * \brief Function of the UART Task to be called by the FreeRTOS kernel
+ *
+ * First negotiates the link rate with the other board, then sleeps until the UART interrupt
+ * has received bytes and decodes them into frames.
+ *
+ * \param pvParameters		Unused
  */
-typedef struct
-{
-	char msgType;
-	char msg[UART_FRAME_SIZE];
-} _UartFrame;
+void vUartTask(void *pvParameters);
 
 /**
- * \union UartFrame
- * \brief Allows UART message to be accessed with structure or as a bit stream
+ * \brief Sets whether this board leads the baud rate negotiation, must be called before the UART task starts
+ *
+ * The master tries each candidate rate, fastest first, asking the slave to switch and echo a test
+ * pattern. The first rate with no bit errors is kept. If the other board does not answer both stay
+ * at UART_BAUD.
+ *
+ * If no frame is decoded for a while, or only errors are, either board drops back to UART_BAUD and
+ * the rate is negotiated again, so a board resetting or a lost commit does not leave the link dead.
+ *
+ * \param master			1 on the master board, 0 on the slave
  */
-typedef union
-{
-	_UartFrame frameWise;                   /**< Allows access with structure */
-	unsigned char byteWise[UART_FRAME_SIZE + 1]; /**< Allows access as a byte stream */
-} UartFrame;
+void setUartMaster(int master);
 
 /**
- * \brief Function type of callbacks for this module
+ * \brief Gets the negotiated link rate
+ *
+ * \return The baud rate in thousands
  */
-typedef void (*uartCallback)(UartFrame *);
+int getUartKbaud(void);
 
 /**
- * \brief Function of the UART Task to be called by the FreeRTOS kernel
+ * \brief Pauses or resumes sending frames from the transmit pool, for example while flash is written
  *
- * \param pvParameters		Unused
+ * Frames may still be claimed and committed while paused, they are sent on resuming.
+ *
+ * \param paused			1 to pause, 0 to resume
  */
-void vUartTask(void *pvParameters);
+void setUartPaused(int paused);
 
 /**
- * \brief Attach callback to be executed on a UART message receive event
+ * \brief Registers a message type, giving its frame length and the handler for received frames
  *
- * \param callback			Callback to execute for receive event
+ * Every type sent or received must be registered, send only types with a NULL handler.
+ * Handlers run in the UART task.
+ *
+ * \param type			Type character of the message
+ * \param length			Length of the frame including the type character
+ * \param binaryOnly		1 if the type is only ever sent in binary frames, so is not accepted without a CRC
+ * \param handler		Callback to execute for received frames of this type, or NULL
+ * \return 0 for success, -1 if the length does not fit in a UartFrame, the type is the sync byte
+ *         or UART_MAX_MSG_TYPES types are already registered
  */
-void attachOnReceiveCallback(void (*callback)(UartFrame *));
+int registerMsgType(char type, unsigned int length, int binaryOnly, uartCallback handler);
 
 /**
- * \brief Queues message to be sent out via UART
+ * \brief Claims a frame buffer from the transmit pool to be filled in place
  * \public \memberof UartFrame
  *
- * \return 0 for success, -1 if queue is full
+ * Every claimed frame must be passed to commitMsgToSend() or commitBinaryMsgToSend(),
+ * after which it belongs to the transmitter and must not be touched.
+ *
+ * \return The frame to fill, NULL if the pool is exhausted or the link is not ready
+ */
+UartFrame *claimMsgToSend(void);
+
+/**
+ * \brief Hands a claimed frame to the transmitter to be sent as is
+ * \public \memberof UartFrame
+ *
+ * \param uartFrame Frame returned by claimMsgToSend()
+ * \return 0 for success, -1 if the type is not registered, the frame is then released
+ */
+int commitMsgToSend(UartFrame *uartFrame);
+
+/**
+ * \brief Hands a claimed frame to the transmitter to be sent in a binary frame with sync byte and CRC
+ * \public \memberof UartFrame
+ *
+ * \param uartFrame Frame returned by claimMsgToSend()
+ * \return 0 for success, -1 if the type is not registered, the frame is then released
+ */
+int commitBinaryMsgToSend(UartFrame *uartFrame);
+
+/**
+ * \brief Queues message to be sent out via UART, copying it into the transmit pool
+ * \public \memberof UartFrame
+ *
+ * \return 0 for success, -1 if the transmit buffer is full or the type is not registered,
+ *         -2 if the UART is not initialised or is negotiating the link rate
  */
 int queueMsgToSend(UartFrame *uartFrame);
 
 /**
- * \brief Returns no. of slots left on the queue
+ * \brief Queues message to be sent out via UART in a binary frame with sync byte and CRC, copying it into the transmit pool
+ * \public \memberof UartFrame
+ *
+ * Frames which fail the CRC check are dropped by the receiver.
+ *
+ * \return 0 for success, -1 if the transmit buffer is full or the type is not registered,
+ *         -2 if the UART is not initialised or is negotiating the link rate
+ */
+int queueBinaryMsgToSend(UartFrame *uartFrame);
+
+/**
+ * \brief Returns no. of unclaimed frames in the transmit pool
  *
- * \return Number of spaces left on queue
+ * \return Number of frames that can be claimed
  */
 int getSendQueueAvailSpaces(void);
 
@@ -27,7 +27,30 @@
 #ifndef WUS_SIMULATE_TASK_H
 #define WUS_SIMULATE_TASK_H
 
-#include "shared_tracenode.h"
+#include "shared_tracebuffer.h"
+
+/**
+ * \brief Channels of the dynamics trace, each as a percentage of its full scale.
+ */
+enum DynamicsChannel
+{
+	DYNAMICS_ACC_SPRUNG,     /**< Sprung mass acceleration. */
+	DYNAMICS_COIL_EXTENSION, /**< Coil extension. */
+	DYNAMICS_FORCE,          /**< Actuator force. */
+	DYNAMICS_CHANNELS        /**< Number of channels. */
+};
+
+/**
+ * \brief Errors that can trigger a capture of the dynamics, as they are raised.
+ */
+enum CaptureTrigger
+{
+	CAPTURE_TRIGGER_OFF,     /**< Not capturing. */
+	CAPTURE_TRIGGER_COIL,    /**< Coil extension exceeded. */
+	CAPTURE_TRIGGER_SPRUNG,  /**< Sprung acceleration exceeded. */
+	CAPTURE_TRIGGER_EITHER,  /**< Either of them. */
+	CAPTURE_TRIGGERS         /**< Number of triggers. */
+};
 
 /**
  * \brief The simulation task.
@@ -69,7 +92,61 @@ int getDisplayCoilExtension();
  *
  * \param roadBuffer A pointer to the buffer.
  */
-void setRoadBuffer(CircularBufferHandler *roadBuffer);
+void setRoadBuffer(CompactTraceBuffer *roadBuffer);
+
+/**
+ * \brief Set the buffer for writing the dynamics to, as percentages of full scale.
+ *
+ * \param dynamicsBuffer A pointer to a buffer of DYNAMICS_CHANNELS channels, x counting samples.
+ */
+void setDynamicsBuffer(CompactTraceBuffer *dynamicsBuffer);
+
+/**
+ * \brief Set the buffer for capturing the dynamics every step around a trigger.
+ *
+ * The buffer is armed with the trigger set by setCaptureTrigger, and dumped over the debug UART
+ * once it freezes.
+ *
+ * \param captureBuffer A pointer to a buffer of DYNAMICS_CHANNELS channels, x counting steps.
+ * \param pre Steps to keep before the trigger.
+ * \param post Steps to keep after the trigger.
+ */
+void setCaptureBuffer(CompactTraceBuffer *captureBuffer, unsigned int pre, unsigned int post);
+
+/**
+ * \brief Gets the capture trigger for display.
+ *
+ * \return The index of the trigger, one of the CaptureTrigger values.
+ */
+int getCaptureTrigger();
+
+/**
+ * \brief Sets which errors raised trigger a capture, and re-arms it.
+ *
+ * \param trigger One of the CaptureTrigger values.
+ */
+void setCaptureTrigger(int trigger);
+
+/**
+ * \brief Gets the progress of the capture for display.
+ *
+ * \return The TraceTriggerState of the capture buffer.
+ */
+int getCaptureState();
+
+/**
+ * \brief Gets whether the capture is being dumped over the debug UART for display.
+ *
+ * \return 1 if dumping, 0 otherwise.
+ */
+int getCaptureDumping();
+
+/**
+ * \brief Dumps a frozen capture over the debug UART again.
+ *
+ * \param dump 1 to start a dump.
+ */
+void setCaptureDumping(int dump);
 
 /**
  * \brief Get road status.
@@ -0,0 +1,107 @@
+/**
+ * \file wus_telemetry.h
+ * \brief Streams the simulation state over the debug UART as delta encoded binary records.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Every record is framed as:
+ *
+ *     sync, type, payload length, payload, CRC-8 (Crc8CCITT of type, length and payload)
+ *
+ * A key record ('K') carries the 32 bit tick count and every field as a 32 bit value.
+ * A delta record ('D') carries the ticks since the previous record as a byte, then the fields
+ * compressed against the previous record by shared_compress in run-length mode. All multi-byte
+ * values are little endian. A key record is sent periodically and after any record is dropped, so a decoder
+ * can join the stream at any point.
+ *
+ * This header is also used by the host decoder, so must not depend on the target libraries.
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#ifndef WUS_TELEMETRY_H
+#define WUS_TELEMETRY_H
+
+#include "shared_compress.h"
+
+#define TELEMETRY_BAUD 460800
+#define TELEMETRY_SYNC 0xA5
+#define TELEMETRY_KEY_RECORD 'K'
+#define TELEMETRY_DELTA_RECORD 'D'
+#define TELEMETRY_CAPTURE_RECORD 'C'        /**< A sample of a frozen trace capture. */
+#define TELEMETRY_KEY_INTERVAL 250          /**< Records between key records. */
+#define TELEMETRY_TICK_RATE_HZ 5000         /**< Rate of the timestamps, configTICK_RATE_HZ on the target. */
+
+#define TELEMETRY_FRAC_BITS 8               /**< Fractional bits of the fixed point fields sent. */
+
+#define TELEMETRY_ZR 0                      /**< Road displacement (mm). */
+#define TELEMETRY_ZU 1                      /**< Unsprung mass displacement (mm). */
+#define TELEMETRY_ZS 2                      /**< Sprung mass displacement (mm). */
+#define TELEMETRY_VR 3                      /**< Road velocity (mm/s). */
+#define TELEMETRY_VU 4                      /**< Unsprung mass velocity (mm/s). */
+#define TELEMETRY_VS 5                      /**< Sprung mass velocity (mm/s). */
+#define TELEMETRY_FORCE 6                   /**< Actuator force (N). */
+#define TELEMETRY_ERROR 7                   /**< combinedError bits, not fixed point. */
+#define TELEMETRY_FIELDS 8
+
+#define TELEMETRY_RUN_LENGTH 1              /**< Delta records are compressed in run-length mode. */
+
+#define TELEMETRY_HEADER_SIZE 3             /**< Sync, type and length. */
+#define TELEMETRY_KEY_PAYLOAD (4 + 4 * TELEMETRY_FIELDS)
+#define TELEMETRY_MAX_PAYLOAD (1 + COMPRESS_MAX_RECORD) /**< A worst case delta record, longer than a key record. */
+#define TELEMETRY_MAX_RECORD (TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD + 1)
+
+#define TELEMETRY_CAPTURE_HEADER 4          /**< Capture payload before the values, int16 offset from the trigger and uint16 dx. */
+#define TELEMETRY_CAPTURE_MAX_CHANNELS 4    /**< Most int16 values a capture record carries. */
+
+#ifndef TELEMETRY_HOST
+
+/**
+ * \brief Initialises the debug UART and its transmit ring for streaming.
+ */
+void initTelemetry(void);
+
+/**
+ * \brief Encodes a record and queues it for sending.
+ *
+ * Records that do not fit in the transmit ring are dropped and the next record sent is a key record.
+ *
+ * \param timestamp The RTOS tick count of the step
+ * \param values The fields, indexed by the TELEMETRY_ field defines
+ */
+void sendTelemetry(unsigned long timestamp, const long values[TELEMETRY_FIELDS]);
+
+/**
+ * \brief Queues a sample of a frozen trace capture for sending.
+ *
+ * Only queued if a worst case telemetry record still fits behind it, so dumping a capture never
+ * costs the stream a key record.
+ *
+ * \param offset Position of the sample relative to the trigger
+ * \param dx Change in x from the previous sample
+ * \param row The value of each channel
+ * \param channels Number of values, at most TELEMETRY_CAPTURE_MAX_CHANNELS
+ * \return 0 if queued, -1 if there is no room yet
+ */
+int sendTelemetryCapture(int offset, int dx, const short *row, unsigned int channels);
+
+#endif
+
+#endif
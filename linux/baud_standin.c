@@ -0,0 +1,368 @@
+/**
+ * \file baud_standin.c
+ * \brief Host stand-in for a board during the link baud rate negotiation, over a pseudo-terminal.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Speaks the negotiation protocol of shared_uart_task.c so either side can be tested without
+ * the other board. Build from the repository root with:
+ *
+ *     gcc -O2 -Iinclude -IStellarisWare -o baud_standin linux/baud_standin.c src/shared_uart_frame.c StellarisWare/utils/crc.c
+ *
+ * Run as the slave (WUS) on a new pseudo-terminal, printing its path:
+ *
+ *     ./baud_standin [-f baud]
+ *
+ * or as the master (ASC) on an existing terminal, e.g. the slave stand-in's pseudo-terminal:
+ *
+ *     ./baud_standin -m /dev/pts/N [-f baud]
+ *
+ * A pseudo-terminal has no real line rate, so -f makes every candidate rate at or above baud
+ * corrupt the loopback pattern, exercising the fall back to slower rates.
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared_uart_task.h"
+
+#define NEGOTIATE_START_MS 2000
+#define NEGOTIATE_WAIT_MS 30000     /**< The stand-in slave waits longer than a board so it can be started first. */
+#define NEGOTIATE_RETRY_MS 20
+#define NEGOTIATE_SETTLE_MS 2
+#define NEGOTIATE_LOOPBACK_MS 20
+#define NEGOTIATE_COMMIT_MS 50
+#define NEGOTIATE_FALLBACK_MS 100
+#define NEGOTIATE_COMMIT_REPEATS 3
+
+static const unsigned long baudCandidates[UART_BAUD_CANDIDATES] = UART_BAUD_CANDIDATE_LIST;
+
+static int linkFd;                     /**< File descriptor of the terminal. */
+static unsigned long baud = UART_BAUD; /**< The rate the stand-in is pretending to run at. */
+static unsigned long failBaud = 0;     /**< Rates at or above this corrupt the loopback, 0 for none. */
+static unsigned char corruptMask;      /**< Bit flipped by this role, different per role so two stand-ins don't cancel out. */
+
+/**
+ * \brief Milliseconds from an arbitrary start.
+ */
+static long nowMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief Reads a byte, waiting until the deadline.
+ *
+ * \return The byte, -1 on timeout
+ */
+static int readByte(long deadline)
+{
+	unsigned char byte;
+	long remaining = deadline - nowMs();
+	struct pollfd pfd = {linkFd, POLLIN, 0};
+
+	if (remaining < 0)
+	{
+		remaining = 0;
+	}
+	if (poll(&pfd, 1, remaining) <= 0 || read(linkFd, &byte, 1) != 1)
+	{
+		return -1;
+	}
+	return byte;
+}
+
+/**
+ * \brief Writes a byte, corrupting it if the pretend rate is set to fail.
+ */
+static void writeByte(unsigned char byte, int corruptible)
+{
+	if (corruptible && failBaud && baud >= failBaud)
+	{
+		byte ^= corruptMask;
+	}
+	if (write(linkFd, &byte, 1) != 1)
+	{
+		perror("write");
+		exit(1);
+	}
+}
+
+static void setBaud(unsigned long newBaud)
+{
+	tcdrain(linkFd);
+	tcflush(linkFd, TCIFLUSH);
+	baud = newBaud;
+	fprintf(stderr, "switched to %lu baud\n", baud);
+}
+
+static void sendNegotiateFrame(char type, unsigned char candidate)
+{
+	UartFrame frame;
+	unsigned char encoded[UART_MAX_ENCODED];
+	unsigned int length;
+	unsigned int i;
+
+	frame.frameWise.msgType = type;
+	frame.frameWise.msg[0] = candidate;
+	length = encodeFrame(&frame, NEGOTIATE_MSG_LEN, 1, encoded);
+	for (i = 0; i < length; i++)
+	{
+		writeByte(encoded[i], 0);
+	}
+}
+
+/**
+ * \brief Waits for a negotiation frame of the given type, ignoring anything else.
+ *
+ * \return The candidate index, -1 on timeout
+ */
+static int waitNegotiateFrame(char type, long timeoutMs)
+{
+	long deadline = nowMs() + timeoutMs;
+	UartFrame frame;
+	unsigned int index = 0;
+	unsigned short crc = 0;
+	int synced = 0;
+	int byte;
+
+	while ((byte = readByte(deadline)) >= 0)
+	{
+		if (!synced)
+		{
+			synced = byte == UART_SYNC_BYTE;
+			index = 0;
+			crc = 0;
+			continue;
+		}
+
+		if (index < NEGOTIATE_MSG_LEN)
+		{
+			frame.byteWise[index] = byte;
+		}
+		else
+		{
+			crc |= byte << (8 * (index - NEGOTIATE_MSG_LEN));
+		}
+		index++;
+		if (index == 1 && frame.frameWise.msgType != type)
+		{
+			synced = byte == UART_SYNC_BYTE;
+			index = 0;
+		}
+		else if (index == NEGOTIATE_MSG_LEN + UART_CRC_BYTES)
+		{
+			if (getFrameCrc(&frame, NEGOTIATE_MSG_LEN) == crc)
+			{
+				return (unsigned char)frame.frameWise.msg[0];
+			}
+			synced = 0;
+		}
+	}
+
+	return -1;
+}
+
+static unsigned int loopbackBitErrors(void)
+{
+	unsigned int errors = 0;
+	unsigned int i;
+
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		writeByte(NEGOTIATE_PATTERN(i), 1);
+	}
+
+	long deadline = nowMs() + NEGOTIATE_LOOPBACK_MS;
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		int echoed = readByte(deadline);
+		if (echoed < 0)
+		{
+			return errors + 8 * (NEGOTIATE_LOOPBACK_BYTES - i);
+		}
+		errors += __builtin_popcount((unsigned char)echoed ^ NEGOTIATE_PATTERN(i));
+	}
+
+	return errors;
+}
+
+static int echoLoopback(void)
+{
+	long deadline = nowMs() + NEGOTIATE_LOOPBACK_MS;
+	unsigned int i;
+
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		int received = readByte(deadline);
+		if (received < 0)
+		{
+			return -1;
+		}
+		writeByte(received, 1);
+	}
+
+	return 0;
+}
+
+static void negotiateMaster(void)
+{
+	long start = nowMs();
+	unsigned char candidate;
+
+	for (candidate = 0; candidate < UART_BAUD_CANDIDATES; candidate++)
+	{
+		int acknowledged;
+		do
+		{
+			sendNegotiateFrame(NEGOTIATE_REQUEST_MSG, candidate);
+			acknowledged = waitNegotiateFrame(NEGOTIATE_ACK_MSG, NEGOTIATE_RETRY_MS);
+		}
+		while (acknowledged != candidate && nowMs() - start < NEGOTIATE_START_MS);
+
+		if (acknowledged != candidate)
+		{
+			fprintf(stderr, "no answer from the slave\n");
+			return;
+		}
+
+		setBaud(baudCandidates[candidate]);
+		usleep(NEGOTIATE_SETTLE_MS * 1000);
+
+		unsigned int errors = loopbackBitErrors();
+		fprintf(stderr, "loopback at %lu baud: %u bit errors\n", baud, errors);
+		if (errors == 0)
+		{
+			unsigned int repeat;
+			for (repeat = 0; repeat < NEGOTIATE_COMMIT_REPEATS; repeat++)
+			{
+				sendNegotiateFrame(NEGOTIATE_COMMIT_MSG, candidate);
+			}
+			return;
+		}
+
+		setBaud(UART_BAUD);
+		usleep(NEGOTIATE_FALLBACK_MS * 1000);
+		start = nowMs();
+	}
+}
+
+static void negotiateSlave(void)
+{
+	long timeout = NEGOTIATE_WAIT_MS;
+
+	for (;;)
+	{
+		int candidate = waitNegotiateFrame(NEGOTIATE_REQUEST_MSG, timeout);
+		if (candidate < 0 || candidate >= UART_BAUD_CANDIDATES)
+		{
+			fprintf(stderr, "no request from the master\n");
+			return;
+		}
+
+		sendNegotiateFrame(NEGOTIATE_ACK_MSG, candidate);
+		setBaud(baudCandidates[candidate]);
+
+		if (echoLoopback() == 0 && waitNegotiateFrame(NEGOTIATE_COMMIT_MSG, NEGOTIATE_COMMIT_MS) == candidate)
+		{
+			return;
+		}
+
+		setBaud(UART_BAUD);
+		timeout = NEGOTIATE_START_MS;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *masterPath = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:f:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'm':
+			masterPath = optarg;
+			break;
+		case 'f':
+			failBaud = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-m terminal] [-f baud]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (masterPath)
+	{
+		linkFd = open(masterPath, O_RDWR | O_NOCTTY);
+	}
+	else
+	{
+		linkFd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (linkFd >= 0 && (grantpt(linkFd) || unlockpt(linkFd)))
+		{
+			linkFd = -1;
+		}
+	}
+	if (linkFd < 0)
+	{
+		perror(masterPath ? masterPath : "posix_openpt");
+		return 1;
+	}
+
+	struct termios tio;
+	if (tcgetattr(linkFd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tcsetattr(linkFd, TCSANOW, &tio);
+	}
+
+	if (masterPath)
+	{
+		corruptMask = 0x01;
+		negotiateMaster();
+	}
+	else
+	{
+		corruptMask = 0x80;
+		printf("%s\n", ptsname(linkFd));
+		fflush(stdout);
+		negotiateSlave();
+		/* keep the terminal open while the master repeats the commit */
+		usleep(NEGOTIATE_COMMIT_MS * 1000);
+	}
+
+	printf("negotiated %lu baud\n", baud);
+	return 0;
+}
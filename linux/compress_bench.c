@@ -0,0 +1,189 @@
+/**
+ * \file compress_bench.c
+ * \brief Host benchmark of the shared_compress record compressor.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Build and run from the repository root with:
+ *
+ *     gcc -O2 -Iinclude -o compress_bench linux/compress_bench.c src/shared_compress.c -lm
+ *     ./compress_bench [records.bin]
+ *
+ * Without an argument synthetic suspension and road trace signals are used. With an argument the
+ * records are read from the output of telemetry_decode -b. Every record is decompressed again and
+ * checked. Reports the compression ratio against raw 32 bit values and the host time per record in
+ * nanoseconds. The time only compares the modes, it says nothing of the cost on the Cortex-M3.
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "shared_compress.h"
+
+#define BENCH_UNIT "host ns"
+static unsigned long long now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define SYNTHETIC_RECORDS 100000
+#define SYNTHETIC_CHANNELS 8
+#define FRAC_BITS 8
+
+/**
+ * \brief Fills records with signals shaped like the simulation, sampled at 1 kHz.
+ */
+static unsigned int makeSynthetic(int32_t *records)
+{
+	unsigned int i;
+	double zS = 0, vS = 0, zU = 0, vU = 0;
+
+	srand(463);
+	for (i = 0; i < SYNTHETIC_RECORDS; i++)
+	{
+		double t = i / 1000.0;
+		double zR = 20 * sin(2 * M_PI * 1.5 * t) + (rand() % 100) / 100.0;
+		double aU = 200 * (zR - zU) - 100 * (zU - zS) - 5 * vU;
+		double aS = 20 * (zU - zS) - 2 * vS;
+		vU += aU / 1000;
+		zU += vU / 1000;
+		vS += aS / 1000;
+		zS += vS / 1000;
+
+		int32_t *record = &records[i * SYNTHETIC_CHANNELS];
+		record[0] = (int32_t)(zR * (1 << FRAC_BITS));
+		record[1] = (int32_t)(zU * (1 << FRAC_BITS));
+		record[2] = (int32_t)(zS * (1 << FRAC_BITS));
+		record[3] = i * 100;                     // trace x, distance travelled
+		record[4] = (int32_t)zR;                 // trace y, whole mm
+		record[5] = (int32_t)(vS * (1 << FRAC_BITS));
+		record[6] = (int32_t)(aS * (1 << FRAC_BITS));
+		record[7] = (i / 5000) & 3;              // error bits
+	}
+	return SYNTHETIC_RECORDS;
+}
+
+/**
+ * \brief Compresses and decompresses every record, reporting ratio and speed.
+ */
+static int bench(const int32_t *records, unsigned int count, unsigned int channels, int runLength)
+{
+	Compressor compressor;
+	Compressor decompressor;
+	unsigned char *stream = malloc((size_t)count * COMPRESS_MAX_RECORD);
+	unsigned int *lengths = malloc(count * sizeof(unsigned int));
+	unsigned long long compressedBytes = 0;
+	unsigned long long start, compressTime, decompressTime;
+	int32_t decoded[COMPRESS_MAX_CHANNELS];
+	unsigned int i;
+	unsigned int c;
+	int errors = 0;
+
+	compressorInit(&compressor, channels, runLength);
+	start = now();
+	for (i = 0; i < count; i++)
+	{
+		lengths[i] = compressRecord(&compressor, &records[i * channels], &stream[compressedBytes]);
+		compressedBytes += lengths[i];
+	}
+	compressTime = now() - start;
+
+	compressorInit(&decompressor, channels, runLength);
+	unsigned long long offset = 0;
+	start = now();
+	for (i = 0; i < count; i++)
+	{
+		offset += decompressRecord(&decompressor, &stream[offset], lengths[i], decoded);
+		for (c = 0; c < channels; c++)
+		{
+			errors += decoded[c] != records[i * channels + c];
+		}
+	}
+	decompressTime = now() - start;
+
+	printf("%-11s ratio %5.2f  %6.2f bytes/record  compress %7.1f %s/record  decompress %7.1f %s/record  %s\n",
+		runLength ? "run-length" : "delta",
+		(double)count * channels * 4 / compressedBytes, (double)compressedBytes / count,
+		(double)compressTime / count, BENCH_UNIT, (double)decompressTime / count, BENCH_UNIT,
+		errors ? "MISMATCH" : "ok");
+
+	free(stream);
+	free(lengths);
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	int32_t *records;
+	unsigned int count;
+	unsigned int channels;
+
+	if (argc > 1)
+	{
+		// records of a uint32 tick count then the fields, from telemetry_decode -b
+		FILE *in = fopen(argv[1], "rb");
+		if (in == NULL)
+		{
+			perror(argv[1]);
+			return 1;
+		}
+		fseek(in, 0, SEEK_END);
+		long size = ftell(in);
+		fseek(in, 0, SEEK_SET);
+		channels = COMPRESS_MAX_CHANNELS;
+		count = size / (4 * (channels + 1));
+		int32_t *raw = malloc((size_t)count * (channels + 1) * 4);
+		records = malloc((size_t)count * channels * 4);
+		if (fread(raw, 4 * (channels + 1), count, in) != count)
+		{
+			fprintf(stderr, "short read\n");
+			return 1;
+		}
+		unsigned int i;
+		unsigned int c;
+		for (i = 0; i < count; i++)
+		{
+			for (c = 0; c < channels; c++)
+			{
+				records[i * channels + c] = raw[i * (channels + 1) + 1 + c];
+			}
+		}
+		free(raw);
+		fclose(in);
+	}
+	else
+	{
+		channels = SYNTHETIC_CHANNELS;
+		records = malloc((size_t)SYNTHETIC_RECORDS * channels * 4);
+		count = makeSynthetic(records);
+	}
+
+	printf("%u records of %u channels\n", count, channels);
+	int errors = bench(records, count, channels, 0) + bench(records, count, channels, 1);
+
+	free(records);
+	return errors != 0;
+}
@@ -0,0 +1,598 @@
+/**
+ * \file link_emulator.c
+ * \brief Host emulator of the board link, benchmarking the frame protocol through an impaired line.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * An ASC endpoint and a WUS endpoint exchange frames over socketpairs through an emulated line
+ * which paces bytes at the baud rate and injects latency, byte loss and bit flips. Both endpoints
+ * use the same frame encoder and decoder as the firmware. Build from the repository root with:
+ *
+ *     gcc -O2 -Iinclude -IStellarisWare -o link_emulator linux/link_emulator.c src/shared_uart_frame.c StellarisWare/utils/crc.c
+ *
+ * and run, for example with 0.1% byte loss and 1 in 1000 bytes having a bit flipped:
+ *
+ *     ./link_emulator -b 625000 -l 1 -d 0.001 -e 0.001 -n 20000
+ *
+ * Options:
+ *     -b baud     line rate, 10 bits per byte (default UART_BAUD)
+ *     -l ms       one way latency added to every byte (default 0)
+ *     -d p        probability of each byte being lost (default 0)
+ *     -e p        probability of each byte having one bit flipped (default 0)
+ *     -n frames   number of control frames the ASC sends (default 10000)
+ *     -r hz       control frame rate, 0 to saturate the line (default 0)
+ *     -s seed     seed of the impairments (default 1)
+ *
+ * The ASC sends stamped control frames, the WUS answers each with a stamped status frame so round
+ * trip times can be measured as on the boards. At the end the decoder throughput is measured on
+ * an in-memory stream without the line.
+ *
+ * Exits with 1 if any corrupted frame was accepted.
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared_uart_task.h"
+
+#define LINE_QUEUE_SIZE 65536         /**< Bytes on the emulated line, a power of 2. */
+#define ENDPOINT_WINDOW 64            /**< Unsent bytes an endpoint may have, like the transmit pool. */
+#define UART_FIFO_BYTES 16            /**< Bytes an endpoint may have waiting on the line, like the UART FIFO. */
+#define RTT_BINS 8                    /**< Round trip histogram bins, doubling from 1ms. */
+#define BENCH_FRAMES 200000
+
+/**
+ * \brief One direction of the emulated line.
+ */
+typedef struct
+{
+	int in;                                   /**< Socket the sending endpoint writes to. */
+	int out;                                  /**< Socket the receiving endpoint reads from. */
+	unsigned char bytes[LINE_QUEUE_SIZE];
+	double due[LINE_QUEUE_SIZE];              /**< When each byte arrives at the receiver. */
+	unsigned int head;
+	unsigned int tail;
+	double lineFree;                          /**< When the sender's shift register is next free. */
+	unsigned long lost;
+	unsigned long flipped;
+} Line;
+
+/**
+ * \brief One board's end of the link.
+ */
+typedef struct
+{
+	int txFd;                                 /**< Socket to the line this endpoint sends on. */
+	int rxFd;                                 /**< Socket from the line this endpoint receives on. */
+	const Line *txLine;                       /**< The line this endpoint sends on. */
+	FrameRegistry registry;
+	FrameDecoder decoder;
+	unsigned char pending[ENDPOINT_WINDOW + UART_MAX_ENCODED];
+	unsigned int pendingLength;
+	unsigned long txDrops;                    /**< Frames not sent because too much was unsent. */
+	unsigned long bytesReceived;
+	unsigned long frames;
+	unsigned long crcErrors;
+	unsigned long resyncs;
+	unsigned long corrupt;                    /**< CRC checked frames accepted with contents that were not sent. */
+	long disturbedAt;                         /**< Byte count when the decoder lost a frame, -1 if in sync. */
+	unsigned long resyncCount;
+	unsigned long resyncBytes;
+	unsigned long resyncMax;
+} Endpoint;
+
+static double baud = UART_BAUD;
+static double latency = 0;
+static double lossProbability = 0;
+static double flipProbability = 0;
+static unsigned long controlFrames = 10000;
+static double controlRate = 0;
+
+static Line ascToWus;
+static Line wusToAsc;
+static Endpoint asc;
+static Endpoint wus;
+static Endpoint *receiving;                /**< Endpoint whose handler is running. */
+
+static double sendTimes[256];              /**< When each control sequence number was sent. */
+static unsigned long sent;
+static unsigned long controlReceived;
+static unsigned long echoes;
+static double rttTotal;
+static double rttMax;
+static unsigned long rttBins[RTT_BINS];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double uniform(void)
+{
+	return rand() / (RAND_MAX + 1.0);
+}
+
+/**
+ * \brief The earlier of two times, ignoring a time of 0.
+ */
+static double earliest(double time, double other)
+{
+	return other != 0 && other < time ? other : time;
+}
+
+static void setNonBlocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * \brief Connects a line between two endpoints with a socketpair at each end.
+ */
+static void lineInit(Line *line, Endpoint *from, Endpoint *to)
+{
+	int sending[2];
+	int receiving[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sending) || socketpair(AF_UNIX, SOCK_STREAM, 0, receiving))
+	{
+		perror("socketpair");
+		exit(1);
+	}
+
+	from->txFd = sending[0];
+	from->txLine = line;
+	line->in = sending[1];
+	line->out = receiving[0];
+	to->rxFd = receiving[1];
+	setNonBlocking(from->txFd);
+	setNonBlocking(line->in);
+	setNonBlocking(line->out);
+	setNonBlocking(to->rxFd);
+}
+
+/**
+ * \brief Takes bytes off the sending socket and puts them on the line, impaired.
+ */
+static void lineAccept(Line *line, double time)
+{
+	unsigned char chunk[256];
+	ssize_t length;
+
+	while (line->head - line->tail < LINE_QUEUE_SIZE - sizeof(chunk) && (length = read(line->in, chunk, sizeof(chunk))) > 0)
+	{
+		ssize_t i;
+		for (i = 0; i < length; i++)
+		{
+			// the byte still takes up the line when lost, the receiver just never sees a start bit
+			line->lineFree = (line->lineFree > time ? line->lineFree : time) + 10.0 / baud;
+			if (uniform() < lossProbability)
+			{
+				line->lost++;
+				continue;
+			}
+
+			unsigned char byte = chunk[i];
+			if (uniform() < flipProbability)
+			{
+				byte ^= 1 << (rand() % 8);
+				line->flipped++;
+			}
+
+			line->bytes[line->head % LINE_QUEUE_SIZE] = byte;
+			line->due[line->head % LINE_QUEUE_SIZE] = line->lineFree + latency;
+			line->head++;
+		}
+	}
+}
+
+/**
+ * \brief Delivers the bytes which have arrived to the receiving socket.
+ */
+static void lineDeliver(Line *line, double time)
+{
+	while (line->tail != line->head && line->due[line->tail % LINE_QUEUE_SIZE] <= time)
+	{
+		if (write(line->out, &line->bytes[line->tail % LINE_QUEUE_SIZE], 1) != 1)
+		{
+			return; // receiver is behind, try again later
+		}
+		line->tail++;
+	}
+}
+
+/**
+ * \brief Time the next byte arrives, 0 if the line is empty.
+ */
+static double lineNextDue(const Line *line)
+{
+	return line->tail != line->head ? line->due[line->tail % LINE_QUEUE_SIZE] : 0;
+}
+
+/**
+ * \brief Encodes a frame into the endpoint's unsent bytes.
+ *
+ * \return 0 for success, -1 if the endpoint has too much unsent
+ */
+static int endpointSend(Endpoint *endpoint, UartFrame *frame, int binary)
+{
+	if (endpoint->pendingLength > ENDPOINT_WINDOW)
+	{
+		endpoint->txDrops++;
+		return -1;
+	}
+
+	endpoint->pendingLength += encodeFrame(frame, getFrameLength(&endpoint->registry, frame->frameWise.msgType), binary,
+			&endpoint->pending[endpoint->pendingLength]);
+	return 0;
+}
+
+/**
+ * \brief Writes unsent bytes to the line while its FIFO has room, so a saturated line queues in the endpoint.
+ */
+static void endpointFlush(Endpoint *endpoint, double time)
+{
+	double queued = (endpoint->txLine->lineFree - time) * baud / 10;
+	unsigned int room = queued < UART_FIFO_BYTES ? UART_FIFO_BYTES - (queued > 0 ? (unsigned int)queued : 0) : 0;
+
+	if (room > endpoint->pendingLength)
+	{
+		room = endpoint->pendingLength;
+	}
+	if (room == 0)
+	{
+		return;
+	}
+
+	ssize_t written = write(endpoint->txFd, endpoint->pending, room);
+	if (written > 0)
+	{
+		memmove(endpoint->pending, &endpoint->pending[written], endpoint->pendingLength - written);
+		endpoint->pendingLength -= written;
+	}
+}
+
+/**
+ * \brief Notes that a frame arrived intact, ending any resynchronisation.
+ */
+static void endpointInSync(Endpoint *endpoint)
+{
+	if (endpoint->disturbedAt >= 0)
+	{
+		unsigned long bytes = endpoint->bytesReceived - endpoint->disturbedAt;
+		endpoint->resyncCount++;
+		endpoint->resyncBytes += bytes;
+		if (bytes > endpoint->resyncMax)
+		{
+			endpoint->resyncMax = bytes;
+		}
+		endpoint->disturbedAt = -1;
+	}
+}
+
+static void endpointReceive(Endpoint *endpoint)
+{
+	unsigned char chunk[256];
+	ssize_t length;
+
+	while ((length = read(endpoint->rxFd, chunk, sizeof(chunk))) > 0)
+	{
+		ssize_t i;
+		for (i = 0; i < length; i++)
+		{
+			endpoint->bytesReceived++;
+			switch (decodeFrameByte(&endpoint->decoder, chunk[i]))
+			{
+			case DECODE_FRAME:
+				endpoint->frames++;
+				receiving = endpoint;
+				dispatchFrame(&endpoint->registry, &endpoint->decoder.frame);
+				break;
+			case DECODE_CRC_ERROR:
+				endpoint->crcErrors++;
+				if (endpoint->disturbedAt < 0)
+				{
+					endpoint->disturbedAt = endpoint->bytesReceived;
+				}
+				break;
+			case DECODE_RESYNC:
+				endpoint->resyncs++;
+				if (endpoint->disturbedAt < 0)
+				{
+					endpoint->disturbedAt = endpoint->bytesReceived;
+				}
+				break;
+			case DECODE_NONE:
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Fills in the control frame for a sequence number, so the WUS can check what it receives.
+ */
+static void fillControl(UartFrame *frame, unsigned char sequence)
+{
+	frame->frameWise.msgType = STAMPED_CONTROL_BINARY_MSG;
+	frame->frameWise.msg[0] = sequence * 7;
+	frame->frameWise.msg[1] = sequence ^ 0x5A;
+	frame->frameWise.msg[2] = sequence % 3;
+	frame->frameWise.msg[3] = 0;
+	frame->frameWise.msg[4] = 0;
+	frame->frameWise.msg[5] = sequence;
+	frame->frameWise.msg[6] = ~sequence;
+	frame->frameWise.msg[7] = sequence >> 4;
+}
+
+/**
+ * \brief WUS handler, checks the control frame and echoes its stamp in a status frame.
+ */
+static void readStampedControlMessage(UartFrame *uartFrame)
+{
+	UartFrame expected;
+	UartFrame status;
+	unsigned char sequence = uartFrame->frameWise.msg[5];
+
+	fillControl(&expected, sequence);
+	if (memcmp(expected.byteWise, uartFrame->byteWise, STAMPED_CONTROL_BINARY_LEN))
+	{
+		receiving->corrupt++;
+		return;
+	}
+	endpointInSync(receiving);
+
+	controlReceived++;
+
+	status.frameWise.msgType = STAMPED_STATUS_BINARY_MSG;
+	status.frameWise.msg[0] = 0;
+	status.frameWise.msg[1] = sequence;
+	status.frameWise.msg[2] = uartFrame->frameWise.msg[6];
+	status.frameWise.msg[3] = uartFrame->frameWise.msg[7];
+	endpointSend(&wus, &status, 1);
+}
+
+/**
+ * \brief ASC handler, measures the round trip of the echoed stamp.
+ */
+static void readStampedStatusMessage(UartFrame *uartFrame)
+{
+	unsigned char sequence = uartFrame->frameWise.msg[1];
+	if (uartFrame->frameWise.msg[0] != 0 || (unsigned char)uartFrame->frameWise.msg[2] != (unsigned char)~sequence)
+	{
+		receiving->corrupt++;
+		return;
+	}
+	endpointInSync(receiving);
+
+	double rtt = now() - sendTimes[sequence];
+	unsigned int bin = 0;
+	while (bin < RTT_BINS - 1 && rtt >= 0.001 * (1 << bin))
+	{
+		bin++;
+	}
+	rttBins[bin]++;
+	rttTotal += rtt;
+	if (rtt > rttMax)
+	{
+		rttMax = rtt;
+	}
+	echoes++;
+}
+
+static void endpointInit(Endpoint *endpoint)
+{
+	registerFrameType(&endpoint->registry, STAMPED_CONTROL_BINARY_MSG, STAMPED_CONTROL_BINARY_LEN, 1,
+			endpoint == &wus ? readStampedControlMessage : NULL);
+	registerFrameType(&endpoint->registry, STAMPED_STATUS_BINARY_MSG, STAMPED_STATUS_BINARY_LEN, 1,
+			endpoint == &asc ? readStampedStatusMessage : NULL);
+	frameDecoderInit(&endpoint->decoder, &endpoint->registry);
+	endpoint->disturbedAt = -1;
+}
+
+/**
+ * \brief Sends the ASC's frames when they are due and there is room.
+ */
+static void ascSend(double time, double start)
+{
+	// a saturating ASC waits for room rather than dropping frames
+	while (sent < controlFrames && (controlRate == 0 || time - start >= sent / controlRate)
+			&& asc.pendingLength + 2 * UART_MAX_ENCODED <= ENDPOINT_WINDOW)
+	{
+		UartFrame frame;
+		fillControl(&frame, sent);
+		endpointSend(&asc, &frame, 1);
+		sendTimes[sent % 256] = time;
+		sent++;
+	}
+}
+
+static void printResync(const char *name, const Endpoint *endpoint)
+{
+	printf("%s: %lu frames, %lu crc errors, %lu resyncs, %lu corrupt accepted, %lu send drops",
+			name, endpoint->frames, endpoint->crcErrors, endpoint->resyncs, endpoint->corrupt,
+			endpoint->txDrops);
+	if (endpoint->resyncCount)
+	{
+		double mean = (double)endpoint->resyncBytes / endpoint->resyncCount;
+		printf(", resync %.1f bytes (%.0fus) mean, %lu bytes max", mean, mean * 10e6 / baud, endpoint->resyncMax);
+	}
+	printf("\n");
+}
+
+/**
+ * \brief Measures how fast the decoder consumes a stream of frames, without the line.
+ */
+static void benchDecoder(void)
+{
+	unsigned char *stream = malloc(BENCH_FRAMES * UART_MAX_ENCODED);
+	unsigned long length = 0;
+	unsigned long decoded = 0;
+	unsigned long i;
+	FrameRegistry registry;
+	FrameDecoder decoder;
+
+	memset(&registry, 0, sizeof(registry));
+	registerFrameType(&registry, STAMPED_CONTROL_BINARY_MSG, STAMPED_CONTROL_BINARY_LEN, 1, NULL);
+	frameDecoderInit(&decoder, &registry);
+
+	for (i = 0; i < BENCH_FRAMES; i++)
+	{
+		UartFrame frame;
+		fillControl(&frame, i);
+		length += encodeFrame(&frame, STAMPED_CONTROL_BINARY_LEN, 1, &stream[length]);
+	}
+
+	double start = now();
+	for (i = 0; i < length; i++)
+	{
+		decoded += decodeFrameByte(&decoder, stream[i]) == DECODE_FRAME;
+	}
+	double elapsed = now() - start;
+
+	printf("decoder: %lu of %d frames from %lu bytes in %.1fms, %.1fns per byte\n", decoded, BENCH_FRAMES, length,
+			elapsed * 1e3, elapsed * 1e9 / length);
+	free(stream);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:l:d:e:n:r:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			baud = strtod(optarg, NULL);
+			break;
+		case 'l':
+			latency = strtod(optarg, NULL) / 1000;
+			break;
+		case 'd':
+			lossProbability = strtod(optarg, NULL);
+			break;
+		case 'e':
+			flipProbability = strtod(optarg, NULL);
+			break;
+		case 'n':
+			controlFrames = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			controlRate = strtod(optarg, NULL);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-l ms] [-d loss] [-e flips] [-n frames] [-r hz] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+	srand(seed);
+
+	endpointInit(&asc);
+	endpointInit(&wus);
+	lineInit(&ascToWus, &asc, &wus);
+	lineInit(&wusToAsc, &wus, &asc);
+
+	double start = now();
+	double lastActivity = start;
+	for (;;)
+	{
+		double time = now();
+
+		ascSend(time, start);
+		endpointFlush(&asc, time);
+		endpointFlush(&wus, time);
+		lineAccept(&ascToWus, time);
+		lineAccept(&wusToAsc, time);
+		lineDeliver(&ascToWus, time);
+		lineDeliver(&wusToAsc, time);
+		endpointReceive(&wus);
+		endpointReceive(&asc);
+
+		if (sent < controlFrames || asc.pendingLength || wus.pendingLength || ascToWus.head != ascToWus.tail
+				|| wusToAsc.head != wusToAsc.tail)
+		{
+			lastActivity = time;
+		}
+		else if (time - lastActivity > latency + 0.05)
+		{
+			break; // everything sent has been delivered and answered
+		}
+
+		// sleep until the next byte is due or a transmit FIFO has room, or briefly while the ASC is still sending
+		double wake = time + (sent < controlFrames ? 0.001 : 0.01);
+		wake = earliest(wake, lineNextDue(&ascToWus));
+		wake = earliest(wake, lineNextDue(&wusToAsc));
+		if (asc.pendingLength)
+		{
+			wake = earliest(wake, ascToWus.lineFree);
+		}
+		if (wus.pendingLength)
+		{
+			wake = earliest(wake, wusToAsc.lineFree);
+		}
+		if (wake > time)
+		{
+			struct pollfd fds[4] = {{ascToWus.in, POLLIN, 0}, {wusToAsc.in, POLLIN, 0}, {asc.rxFd, POLLIN, 0}, {wus.rxFd, POLLIN, 0}};
+			struct timespec timeout = {0, (long)((wake - time) * 1e9)};
+			ppoll(fds, 4, &timeout, NULL);
+		}
+	}
+	double elapsed = lastActivity - start;
+
+	printf("line: %.0f baud, %.1fms latency, %lu bytes lost, %lu bits flipped\n", baud, latency * 1e3,
+			ascToWus.lost + wusToAsc.lost, ascToWus.flipped + wusToAsc.flipped);
+	printf("control: %lu sent, %lu received, %lu lost, %.0f frames/s in %.2fs\n", sent, controlReceived,
+			sent - controlReceived, controlReceived / elapsed, elapsed);
+	printResync("wus", &wus);
+	printResync("asc", &asc);
+	if (echoes)
+	{
+		unsigned int bin;
+		printf("rtt: %lu echoes, %.2fms mean, %.2fms max, histogram", echoes, rttTotal * 1e3 / echoes, rttMax * 1e3);
+		for (bin = 0; bin < RTT_BINS; bin++)
+		{
+			printf(" %lu", rttBins[bin]);
+		}
+		printf("\n");
+	}
+	benchDecoder();
+
+	if (wus.corrupt || asc.corrupt)
+	{
+		fprintf(stderr, "corrupted CRC checked frames were accepted\n");
+		return 1;
+	}
+	return 0;
+}
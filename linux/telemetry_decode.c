@@ -0,0 +1,278 @@
+/**
+ * \file telemetry_decode.c
+ * \brief Host tool decoding the WUS telemetry stream into CSV or fixed size binary records.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ *
+ * Build and run from the repository root with:
+ *
+ *     gcc -O2 -Iinclude -IStellarisWare -o telemetry_decode linux/telemetry_decode.c src/shared_compress.c StellarisWare/utils/crc.c
+ *     stty -F /dev/ttyUSB0 460800 raw
+ *     ./telemetry_decode /dev/ttyUSB0 > run.csv
+ *
+ * With -b each record is written as a little endian uint32 tick count followed by the
+ * TELEMETRY_FIELDS int32 fields, ready to be loaded as columns (e.g. numpy.fromfile).
+ *
+ * With -c capture.csv the samples of frozen trace captures dumped by the WUS are written there,
+ * each as its offset from the trigger, change in x from the previous sample and channel values.
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TELEMETRY_HOST
+#include "wus_telemetry.h"
+#include "utils/crc.h"
+
+static const char *fieldNames[TELEMETRY_FIELDS] = {"zR", "zU", "zS", "vR", "vU", "vS", "force", "combinedError"};
+
+static uint32_t timestamp;
+static int32_t values[TELEMETRY_FIELDS];
+static Compressor decompressor;
+static int haveKey = 0;              /**< Deltas are meaningless until a key record has been seen. */
+static unsigned long records = 0;
+static unsigned long crcErrors = 0;
+static unsigned long skipped = 0;    /**< Delta records received while waiting for a key record. */
+static unsigned long captureRows = 0;
+
+/**
+ * \brief Reads a little endian value from a record.
+ */
+static uint32_t getLittleEndian(const unsigned char *in, unsigned int size)
+{
+	uint32_t value = 0;
+	unsigned int i;
+	for (i = 0; i < size; i++)
+	{
+		value |= (uint32_t)in[i] << (8 * i);
+	}
+	return value;
+}
+
+/**
+ * \brief Applies a record payload to the decoder state.
+ *
+ * \return 1 if the state is valid to output, 0 otherwise
+ */
+static int applyRecord(unsigned char type, const unsigned char *payload, unsigned int length)
+{
+	unsigned int field;
+
+	if (type == TELEMETRY_KEY_RECORD)
+	{
+		if (length != TELEMETRY_KEY_PAYLOAD)
+		{
+			return 0;
+		}
+		timestamp = getLittleEndian(payload, 4);
+		for (field = 0; field < TELEMETRY_FIELDS; field++)
+		{
+			values[field] = (int32_t)getLittleEndian(&payload[4 + 4 * field], 4);
+		}
+		compressorSetLast(&decompressor, values);
+		haveKey = 1;
+		return 1;
+	}
+
+	if (type != TELEMETRY_DELTA_RECORD || length < 2)
+	{
+		return 0;
+	}
+	if (!haveKey)
+	{
+		skipped++;
+		return 0;
+	}
+
+	int32_t decoded[TELEMETRY_FIELDS];
+	if (decompressRecord(&decompressor, &payload[1], length - 1, decoded) != length - 1)
+	{
+		haveKey = 0; // malformed, wait for the next key
+		return 0;
+	}
+
+	timestamp += payload[0];
+	for (field = 0; field < TELEMETRY_FIELDS; field++)
+	{
+		values[field] = decoded[field];
+	}
+	return 1;
+}
+
+/**
+ * \brief Writes a capture record as a CSV row.
+ */
+static void writeCaptureRow(FILE *out, const unsigned char *payload, unsigned int length)
+{
+	unsigned int i;
+
+	if (length < TELEMETRY_CAPTURE_HEADER || (length - TELEMETRY_CAPTURE_HEADER) % 2 != 0)
+	{
+		return;
+	}
+
+	fprintf(out, "%d,%u", (int16_t)getLittleEndian(payload, 2), getLittleEndian(&payload[2], 2));
+	for (i = TELEMETRY_CAPTURE_HEADER; i < length; i += 2)
+	{
+		fprintf(out, ",%d", (int16_t)getLittleEndian(&payload[i], 2));
+	}
+	fprintf(out, "\n");
+	captureRows++;
+}
+
+/**
+ * \brief Writes the current decoder state as one output record.
+ */
+static void writeRecord(FILE *out, int binary)
+{
+	unsigned int field;
+
+	if (binary)
+	{
+		unsigned char record[4 + 4 * TELEMETRY_FIELDS];
+		unsigned int i;
+		for (i = 0; i < 4; i++)
+		{
+			record[i] = (unsigned char)(timestamp >> (8 * i));
+		}
+		for (field = 0; field < TELEMETRY_FIELDS; field++)
+		{
+			for (i = 0; i < 4; i++)
+			{
+				record[4 + 4 * field + i] = (unsigned char)((uint32_t)values[field] >> (8 * i));
+			}
+		}
+		fwrite(record, sizeof(record), 1, out);
+		return;
+	}
+
+	fprintf(out, "%.4f", (double)timestamp / TELEMETRY_TICK_RATE_HZ);
+	for (field = 0; field < TELEMETRY_FIELDS; field++)
+	{
+		if (field == TELEMETRY_ERROR)
+		{
+			fprintf(out, ",%d", values[field]);
+		}
+		else
+		{
+			fprintf(out, ",%.4f", (double)values[field] / (1 << TELEMETRY_FRAC_BITS));
+		}
+	}
+	fprintf(out, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	int binary = 0;
+	const char *path = NULL;
+	FILE *capture = NULL;
+	int i;
+
+	compressorInit(&decompressor, TELEMETRY_FIELDS, TELEMETRY_RUN_LENGTH);
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-b") == 0)
+		{
+			binary = 1;
+		}
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+		{
+			capture = fopen(argv[++i], "w");
+			if (capture == NULL)
+			{
+				perror(argv[i]);
+				return 1;
+			}
+			fprintf(capture, "offset,dx,values\n");
+		}
+		else
+		{
+			path = argv[i];
+		}
+	}
+
+	FILE *in = path ? fopen(path, "rb") : stdin;
+	if (in == NULL)
+	{
+		perror(path);
+		return 1;
+	}
+
+	if (!binary)
+	{
+		printf("time");
+		for (i = 0; i < TELEMETRY_FIELDS; i++)
+		{
+			printf(",%s", fieldNames[i]);
+		}
+		printf("\n");
+	}
+
+	unsigned char record[TELEMETRY_MAX_RECORD];
+	unsigned int index = 0;
+	int c;
+
+	while ((c = fgetc(in)) != EOF)
+	{
+		if (index == 0 && c != TELEMETRY_SYNC)
+		{
+			continue; // hunting for the start of a record
+		}
+		record[index++] = (unsigned char)c;
+
+		if (index == TELEMETRY_HEADER_SIZE && record[2] > TELEMETRY_MAX_PAYLOAD)
+		{
+			index = 0; // impossible length, resynchronise
+		}
+		else if (index > TELEMETRY_HEADER_SIZE && index == TELEMETRY_HEADER_SIZE + record[2] + 1u)
+		{
+			unsigned int length = record[2];
+			if (Crc8CCITT(0, &record[1], length + 2) != record[TELEMETRY_HEADER_SIZE + length])
+			{
+				crcErrors++;
+				haveKey = 0; // a delta may have been lost, wait for the next key
+			}
+			else if (record[1] == TELEMETRY_CAPTURE_RECORD)
+			{
+				if (capture != NULL)
+				{
+					writeCaptureRow(capture, &record[TELEMETRY_HEADER_SIZE], length);
+				}
+			}
+			else if (applyRecord(record[1], &record[TELEMETRY_HEADER_SIZE], length))
+			{
+				writeRecord(stdout, binary);
+				records++;
+			}
+			index = 0;
+		}
+	}
+
+	fprintf(stderr, "%lu records, %lu CRC errors, %lu skipped waiting for a key record, %lu capture samples\n", records, crcErrors, skipped, captureRows);
+	if (capture != NULL)
+	{
+		fclose(capture);
+	}
+	return 0;
+}
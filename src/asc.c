@@ -41,6 +41,8 @@
 #include "shared_guidraw_task.h"
 #include "shared_uart_task.h"
 #include "shared_button_task.h"
+#include "shared_calibration.h"
+#include "shared_link_stats.h"
 
 const char *placeholder = "test";
 
@@ -52,6 +54,9 @@ static ListView controls;
 static ListView statuses;
 static ListView statuses2;
 static ListView invokeWusErrors;
+static ListView linkStats;
+static ListView linkRx;
+static ListView linkRtt;
 
 /*controls options and items*/
 static Item roadTypeItem;
@@ -64,6 +69,8 @@ static Item resetItem;
 static Options resetOption;
 static Item actControlItem;
 static Options actControlOption;
+static Item calibrateItem;
+static Options calibrateOption;
 /*status options and items*/
 static Item carSpeedItem;
 static Options carSpeedOption;
@@ -75,6 +82,8 @@ static Item unsprungAccItem;
 static Options unsprungAccOption;
 static Item sprungAccItem;
 static Options sprungAccOption;
+static Item displayBytesItem;
+static Options displayBytesOption;
 /*Out of Randge options and items*/
 static Item wusStatusCoilItem;
 static Options wusStatusCoilOption;
@@ -103,6 +112,20 @@ static Options involePowerErrorOption;
 static Item invokeWatchdogErrorItem;
 static Options invokeWatchdogErrorOption;
 
+/*link statistics options and items*/
+static Item linkStampsItem;
+static Options linkStampsOption;
+static Options linkCountOption;
+static Item linkTxDropsItem;
+static Item linkPoolPeakItem;
+static Item linkCrcErrorsItem;
+static Item linkResyncsItem;
+static Item linkLostEchoesItem;
+static Item linkBaudItem;
+static Item linkRxOverrunsItem;
+static Item linkFlashPausesItem;
+static Item linkRttItems[LINK_RTT_BINS];
+
 int main(void)
 {
 	/* Set the clocking to run from the PLL at 50 MHz.  Assumes 8MHz XTAL,
@@ -110,10 +133,13 @@ int main(void)
 	SysCtlClockSet(SYSCTL_SYSDIV_4 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN | SYSCTL_XTAL_8MHZ);
 
 	/* Marking up GUI */
-	controls = listView("Controls", 5);
-	statuses = listView("Status", 5);
+	controls = listView("Controls", 6);
+	statuses = listView("Status", 6);
 	statuses2 = listView("WUS Errors", 6);
 	invokeWusErrors = listView("InvokeErr", 6);
+	linkStats = listView("Link", 7);
+	linkRx = listView("Link Rx", 2);
+	linkRtt = listView("RTT Ticks", LINK_RTT_BINS);
 
 	/*controls menu GUI*/
 	roadTypeOption = option(10, 33);
@@ -145,6 +171,12 @@ int main(void)
 	actControlOption.values[1] = "On";
 	actControlItem = item("ActState", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, actControlOption, getAscOn);
 	actControlItem.setter = setAscOn;
+	calibrateOption = option(0, 1);
+	calibrateOption.skip = 1;
+	calibrateOption.values[0] = "Off";
+	calibrateOption.values[1] = "On";
+	calibrateItem = item("Calibrate", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, calibrateOption, getCalibrationSweeping);
+	calibrateItem.setter = setCalibrationSweeping;
 
 	/*Status Menu GUI*/
 	carSpeedOption = option(-999, 999);
@@ -157,6 +189,8 @@ int main(void)
 	unsprungAccItem = item("unsprAc", OPTIONTYPE_INT, OPTIONACCESS_READONLY, unsprungAccOption, getDisplayUnsprungAcc);
 	sprungAccOption = option(-3000, 3000);
 	sprungAccItem = item("sprAc", OPTIONTYPE_INT, OPTIONACCESS_READONLY, sprungAccOption, getDisplaySprungAcc);
+	displayBytesOption = option(0, 99999);
+	displayBytesItem = item("OLED B/s", OPTIONTYPE_INT, OPTIONACCESS_READONLY, displayBytesOption, getDisplayBytesPerSecond);
 
 	/*Out of Range Errors Menu GUI*/
 	wusStatusCoilOption = option(0, 1);
@@ -222,17 +256,43 @@ int main(void)
 	invokeWatchdogErrorItem = item("WatchdogErr", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, invokeWatchdogErrorOption, getWatchdogInvokedError);
 	invokeWatchdogErrorItem.setter = setWatchdogError;
 
+	/*link statistics GUI*/
+	linkStampsOption = option(0, 1);
+	linkStampsOption.skip = 1;
+	linkStampsOption.values[0] = "Off";
+	linkStampsOption.values[1] = "On";
+	linkStampsItem = item("Stamps", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, linkStampsOption, getLinkStamps);
+	linkStampsItem.setter = setLinkStamps;
+	linkCountOption = option(0, 9999);
+	linkTxDropsItem = item("TxDrops", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkTxDrops);
+	linkPoolPeakItem = item("PoolPeak", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkPoolPeak);
+	linkCrcErrorsItem = item("CrcErrs", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkCrcErrors);
+	linkResyncsItem = item("Resyncs", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkResyncs);
+	linkLostEchoesItem = item("LostEcho", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkLostEchoes);
+	linkBaudItem = item("kBaud", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getUartKbaud);
+	linkRxOverrunsItem = item("Overruns", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRxOverruns);
+	linkFlashPausesItem = item("FlashHold", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkFlashPauses);
+	linkRttItems[0] = item("<1", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt0);
+	linkRttItems[1] = item("<2", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt1);
+	linkRttItems[2] = item("<3", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt2);
+	linkRttItems[3] = item("<4", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt3);
+	linkRttItems[4] = item("<5", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt4);
+	linkRttItems[5] = item("<6", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt5);
+	linkRttItems[6] = item(">=6", OPTIONTYPE_INT, OPTIONACCESS_READONLY, linkCountOption, getLinkRtt6);
+
 	/*attach items to ListView*/
 	controls.items[0] = roadTypeItem;
 	controls.items[1] = rideTypeItem;
 	controls.items[2] = throttleItem;
 	controls.items[3] = resetItem;
 	controls.items[4] = actControlItem;
+	controls.items[5] = calibrateItem;
 	statuses.items[0] = carSpeedItem;
 	statuses.items[1] = actuatorForceItem;
 	statuses.items[2] = coilExtensionItem;
 	statuses.items[3] = unsprungAccItem;
 	statuses.items[4] = sprungAccItem;
+	statuses.items[5] = displayBytesItem;
 	statuses2.items[0] = wusStatusCoilItem;
 	statuses2.items[1] = wusStatusSprungItem;
 	statuses2.items[2] = wusStatusUnsprungItem;
@@ -245,6 +305,20 @@ int main(void)
 	invokeWusErrors.items[3] = invokeSpeedErrorItem;
 	invokeWusErrors.items[4] = involePowerErrorItem;
 	invokeWusErrors.items[5] = invokeWatchdogErrorItem;
+	linkStats.items[0] = linkStampsItem;
+	linkStats.items[1] = linkTxDropsItem;
+	linkStats.items[2] = linkPoolPeakItem;
+	linkStats.items[3] = linkCrcErrorsItem;
+	linkStats.items[4] = linkResyncsItem;
+	linkStats.items[5] = linkLostEchoesItem;
+	linkStats.items[6] = linkBaudItem;
+	linkRx.items[0] = linkRxOverrunsItem;
+	linkRx.items[1] = linkFlashPausesItem;
+	unsigned int bin;
+	for (bin = 0; bin < LINK_RTT_BINS; bin++)
+	{
+		linkRtt.items[bin] = linkRttItems[bin];
+	}
 
 	/*init Activity and attach ListViews ot activity*/
 	mainActivity = activity();
@@ -252,6 +326,9 @@ int main(void)
 	addView(&mainActivity, &statuses, VIEWTYPE_LIST);
 	addView(&mainActivity, &statuses2, VIEWTYPE_LIST);
 	addView(&mainActivity, &invokeWusErrors, VIEWTYPE_LIST);
+	addView(&mainActivity, &linkStats, VIEWTYPE_LIST);
+	addView(&mainActivity, &linkRx, VIEWTYPE_LIST);
+	addView(&mainActivity, &linkRtt, VIEWTYPE_LIST);
 	attachActivity(&mainActivity);
 
 	/* Configure buttons */
@@ -263,12 +340,16 @@ int main(void)
 	/*Continously determines the actuator force needed*/
 	xTaskCreate(vControlTask, "Control task", 240, (void *)placeholder, 4, NULL);
 
-	/*Inits UART, continously reads and writes UART messages*/
+	/*Inits UART, leads the link rate negotiation, continously reads and writes UART messages*/
+	setUartMaster(1);
 	xTaskCreate(vUartTask, "UART task", 240, (void *)placeholder, 3, NULL);
 
 	/*Inits button polling and checks for button pushes*/
 	xTaskCreate(vButtonPollingTask, "Button polling task", 240, (void *)placeholder, 2, NULL);
 
+	/*Prints link statistics on the debug UART*/
+	xTaskCreate(vLinkDebugTask, "Link debug task", 240, (void *)placeholder, 1, NULL);
+
 	/* Refreshes GUI */
 	xTaskCreate(vGuiRefreshTask, "Gui refresh task", 240, (void *)placeholder, 1, NULL);
 
@@ -304,6 +385,7 @@ void vApplicationStackOverflowHook(TaskHandle_t *pxTask, signed char *pcTaskName
 void vApplicationIdleHook(void)
 {
 	/* idle hook*/
+	saveCalibration();
 }
 /*-----------------------------------------------------------*/
 
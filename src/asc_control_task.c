@@ -38,11 +38,15 @@
 #include "shared_uart_task.h"
 #include "shared_parameters.h"
 #include "shared_iqmath.h"
+#include "shared_calibration.h"
+#include "shared_link_stats.h"
 
 #include "shared_errors.h"
 
 
 #define CONTROL_TASK_RATE_HZ 1000
+#define LINK_KEEPALIVE_MS 100 /**< Maximum time between control frames when nothing changes */
+#define LINK_KEEPALIVE_CYCLES (LINK_KEEPALIVE_MS * CONTROL_TASK_RATE_HZ / 1000)
 
 #define DAMPING_SEDATE  _IQ(0.100)
 #define DAMPING_NORMAL  _IQ(0.250)
@@ -73,18 +77,25 @@ static int invokePowerError = 0;
 static int invokeWatchdogError = 0;
 
 /**
- * \brief Reads an incoming UART message.
+ * \brief Reads a WUS status message.
  *
  * \param uartFrame Pointer to the uartFrame to read.
  */
-static void readMessage(UartFrame *uartFrame)
+static void readStatusMessage(UartFrame *uartFrame)
 {
-	switch (uartFrame->frameWise.msgType)
-	{
-	case 'W':
-		wusStatus = uartFrame->frameWise.msg[0];
-		break;
-	}
+	wusStatus = uartFrame->frameWise.msg[0];
+}
+
+/**
+ * \brief Reads a WUS status message carrying an echoed stamp.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readStampedStatusMessage(UartFrame *uartFrame)
+{
+	wusStatus = uartFrame->frameWise.msg[0];
+	linkStatsEcho(uartFrame->frameWise.msg[1],
+		(unsigned char)uartFrame->frameWise.msg[2] | ((unsigned char)uartFrame->frameWise.msg[3] << 8));
 }
 
 
@@ -105,52 +116,84 @@ static _iq getDampingCoefficient();
 static _iq getControlForce(int dTime);
 
 /**
- * \brief Formats and Transmits data over serial to simulator
+ * \brief Packs throttle, road, reset and status into one frame and transmits it to the simulator
  *
+ * The frame is only sent when one of the fields has changed or the keepalive period has passed.
  */
 static void sendSerialMessages()
 {
-	// Throttle Transmission
-	UartFrame throttleSend;
+	static _iq lastThrottle;
+	static int lastRoadType;
+	static int lastResetState;
+	static char lastErrorState;
+	static int cyclesSinceSend = LINK_KEEPALIVE_CYCLES;
+	static unsigned char sequence = 0;
 
-	throttleSend.frameWise.msgType = 'A'; // Accel Message Type
-	usprintf(throttleSend.frameWise.msg, "%2d.%03d", throttle >> QG, _IQint(1000 * ((1 << QG) - 1) & throttle));
-	queueMsgToSend(&throttleSend);
+	cyclesSinceSend++;
+	if (cyclesSinceSend < LINK_KEEPALIVE_CYCLES && throttle == lastThrottle && roadType == lastRoadType
+		&& resetState == lastResetState && errorState == lastErrorState)
+	{
+		return; // nothing new to tell the simulator
+	}
+
+	// build the frame straight into the transmit pool, retrying next cycle if it is exhausted
+	UartFrame *controlSend = claimMsgToSend();
+	if (controlSend == NULL)
+	{
+		return;
+	}
 
-	// Road Type Transmission
-	UartFrame roadSend;
-	roadSend.frameWise.msgType = 'R'; // Road Message Type
-	usprintf(roadSend.frameWise.msg, "%2d", roadType);
-	queueMsgToSend(&roadSend);
+	short throttleFixed = (short)(throttle >> (QG - UART_BINARY_FRAC_BITS));
 
-	// Reset Transmission
-	if (resetState)
+	controlSend->frameWise.msgType = CONTROL_BINARY_MSG;
+	controlSend->frameWise.msg[0] = (char)(throttleFixed & 0xFF);
+	controlSend->frameWise.msg[1] = (char)(throttleFixed >> 8);
+	controlSend->frameWise.msg[2] = (char)roadType;
+	controlSend->frameWise.msg[3] = resetState ? CONTROL_RESET_FLAG : 0;
+	controlSend->frameWise.msg[4] = errorState;
+
+	if (getLinkStamps())
 	{
-		UartFrame resetSend;
-		resetSend.frameWise.msgType = 'S'; // Reset Message Type
-		queueMsgToSend(&resetSend);
+		// the WUS echoes these back in its next status frame
+		unsigned short timestamp = getLinkTimestamp();
+		controlSend->frameWise.msgType = STAMPED_CONTROL_BINARY_MSG;
+		controlSend->frameWise.msg[5] = sequence;
+		controlSend->frameWise.msg[6] = (char)(timestamp & 0xFF);
+		controlSend->frameWise.msg[7] = (char)(timestamp >> 8);
 	}
 
-	// Status Transmission
-	UartFrame statusSend;
-	statusSend.frameWise.msgType = 'M';
-	statusSend.frameWise.msg[0] = errorState;
-	queueMsgToSend(&statusSend);
+	commitBinaryMsgToSend(controlSend);
+
+	lastThrottle = throttle;
+	lastRoadType = roadType;
+	lastResetState = resetState;
+	lastErrorState = errorState;
+	cyclesSinceSend = 0;
+	sequence++;
 }
 
 void vControlTask(void *params)
 {
 	// Initialise Controller Modules
 	initPulseIn();
+	initCalibration();
 	initAdcModule(ACC_SPRUNG_ADC | ACC_UNSPRUNG_ADC | COIL_EXTENSION_ADC);
 	initPwmModule(ACTUATOR_FORCE_PWM | DAMPING_COEFF_PWM);
-
-	attachOnReceiveCallback(readMessage);
+	setPwmRange(ACTUATOR_FORCE_PWM, MIN_ACTUATOR_FORCE, MAX_ACTUATOR_FORCE);
+	setPwmRange(DAMPING_COEFF_PWM, MIN_DAMPING_COEFF, MAX_DAMPING_COEFF);
+	setPwmDither(ACTUATOR_FORCE_PWM, 1);
+
+	registerMsgType('W', WUS_STATUS_MSG_LEN, 1, readStatusMessage);
+	registerMsgType(STAMPED_STATUS_BINARY_MSG, STAMPED_STATUS_BINARY_LEN, 1, readStampedStatusMessage);
+	registerMsgType(CONTROL_BINARY_MSG, CONTROL_BINARY_LEN, 1, NULL);
+	registerMsgType(STAMPED_CONTROL_BINARY_MSG, STAMPED_CONTROL_BINARY_LEN, 1, NULL);
 	// Initialise FreeRTOS Sleep Parameters
 	TickType_t pxPreviousWakeTime;
 	const TickType_t xTimeIncrement = configTICK_RATE_HZ / CONTROL_TASK_RATE_HZ;
 	pxPreviousWakeTime = xTaskGetTickCount();
 
+	_iq pwmValues[PWM_NUM_OUTS];
+
 	for (;;)
 	{
 		// Delay until ready
@@ -167,8 +210,19 @@ void vControlTask(void *params)
 		actuatorForce = getControlForce(xTimeIncrement);
 
 		// Set Control Outputs
-		setDuty(ACTUATOR_FORCE_PWM, actuatorForce, MIN_ACTUATOR_FORCE, MAX_ACTUATOR_FORCE);
-		setDuty(DAMPING_COEFF_PWM, dampingCoefficient, MIN_DAMPING_COEFF, MAX_DAMPING_COEFF);
+		int calibrationPoint = updateCalibrationSweep();
+		if (calibrationPoint < 0)
+		{
+			pwmValues[ACTUATOR_FORCE_PWM_INDEX] = actuatorForce;
+			pwmValues[DAMPING_COEFF_PWM_INDEX] = dampingCoefficient;
+		}
+		else
+		{
+			// sweep the outputs for the WUS to calibrate against
+			pwmValues[ACTUATOR_FORCE_PWM_INDEX] = CALIBRATION_VALUE(calibrationPoint, MIN_ACTUATOR_FORCE, MAX_ACTUATOR_FORCE);
+			pwmValues[DAMPING_COEFF_PWM_INDEX] = CALIBRATION_VALUE(calibrationPoint, MIN_DAMPING_COEFF, MAX_DAMPING_COEFF);
+		}
+		setDutyBatch(pwmValues);
 
 		// Send UART messages to WUS
 		sendSerialMessages();
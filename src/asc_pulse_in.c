@@ -29,34 +29,63 @@
 
 #define PULSE_PIN BIT(7)
 
+#define PULSE_TIMER_PERIPH SYSCTL_PERIPH_TIMER2
+#define PULSE_TIMER_BASE TIMER2_BASE
+#define PULSE_AVERAGE_EDGES 4       /**< Number of edge periods averaged per speed reading. */
+#define PULSE_RING_SIZE (PULSE_AVERAGE_EDGES + 1)
+#define PULSE_STALE_MS 250          /**< Time without an edge after which the speed is zero. */
+
 #include "asc_pulse_in.h"
 #include "shared_parameters.h"
 
-#include "FreeRTOS.h"
-#include "task.h"
-
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
 #include "inc/hw_ints.h"
 #include "driverlib/interrupt.h"
 #include "driverlib/sysctl.h"
 #include "driverlib/gpio.h"
+#include "driverlib/timer.h"
 
 
-static volatile TickType_t lastPulseTick;
-static volatile TickType_t lastTickDuration;
+static volatile unsigned long edgeTimes[PULSE_RING_SIZE]; /**< Timer values of the latest edges, the timer counts down. */
+static volatile unsigned int edgeIndex;                   /**< Next slot of edgeTimes to write. */
+static volatile unsigned int edgeCount;                   /**< Number of valid edgeTimes. */
+static unsigned long pulseClock;                          /**< Timer clock rate (Hz). */
+static unsigned long staleCounts;                         /**< PULSE_STALE_MS in timer counts. */
 
 
 /**
- * \brief ISR Triggered on detection of PortF pin change
+ * \brief ISR triggered on a rising edge of the pulse train.
  *
- * The encoder input pin is connected through Port F.
- * Each trigger, the time since the last interrupt is calculated and the car speed determined from this value.
+ * Timestamps the edge with the free running timer. Does not use the FreeRTOS API as it
+ * runs above configMAX_SYSCALL_INTERRUPT_PRIORITY.
  */
 void isrPortF(void);
 
+/**
+ * \brief Initialises the free running timer used to timestamp edges.
+ */
+static void initPulseTimer(void)
+{
+	SysCtlPeripheralEnable(PULSE_TIMER_PERIPH);
+	SysCtlDelay(SysCtlClockGet() / 3000);
+
+	// Full width timer at the CPU clock, wraps every 85s at 50MHz
+	TimerConfigure(PULSE_TIMER_BASE, TIMER_CFG_PERIODIC);
+	TimerLoadSet(PULSE_TIMER_BASE, TIMER_A, 0xFFFFFFFF);
+	TimerControlStall(PULSE_TIMER_BASE, TIMER_A, true);
+	TimerEnable(PULSE_TIMER_BASE, TIMER_A);
+}
+
 void initPulseIn()
 {
+	pulseClock = SysCtlClockGet();
+	staleCounts = pulseClock / 1000 * PULSE_STALE_MS;
+	edgeCount = 0;
+	edgeIndex = 0;
+
+	initPulseTimer();
+
 	// Enable PortF Peripheral
 	SysCtlPeripheralEnable (SYSCTL_PERIPH_GPIOF);
 	SysCtlDelay (SysCtlClockGet() / 3000);
@@ -71,21 +100,65 @@ void initPulseIn()
 
 _iq getPulseSpeed()
 {
-	//Bit shift for extra precision, but not all the way to our fixed point to avoid overflow
-	return ((((long)configTICK_RATE_HZ) << 10) / ((long)lastTickDuration * PULSE_EDGES_PER_M)) << (QG - 10);
+	// Snapshot the edges without the ISR changing them
+	IntDisable(INT_GPIOF);
+	unsigned long now = TimerValueGet(PULSE_TIMER_BASE, TIMER_A);
+	unsigned int count = edgeCount;
+	unsigned int newestIndex = (edgeIndex + PULSE_RING_SIZE - 1) % PULSE_RING_SIZE;
+	unsigned long intervals = count > 1 ? count - 1 : 0;
+	unsigned long newest = edgeTimes[newestIndex];
+	unsigned long oldest = edgeTimes[(newestIndex + PULSE_RING_SIZE - intervals) % PULSE_RING_SIZE];
+	IntEnable(INT_GPIOF);
+
+	if (intervals == 0)
+	{
+		return 0;
+	}
+
+	// Timer counts down, unsigned subtraction handles the wrap
+	unsigned long sinceLast = newest - now;
+	unsigned long span = oldest - newest;
+
+	if (sinceLast > staleCounts)
+	{
+		// Pulses have stopped, forget the edges before the timer wraps and makes them look recent
+		IntDisable(INT_GPIOF);
+		if (edgeIndex == (newestIndex + 1) % PULSE_RING_SIZE)
+		{
+			edgeCount = 0;
+		}
+		IntEnable(INT_GPIOF);
+		return 0;
+	}
+
+	if ((unsigned long long)sinceLast * intervals > span)
+	{
+		// Slowing down, the edge in progress is already longer than the average
+		span = sinceLast;
+		intervals = 1;
+	}
+
+	if (span == 0)
+	{
+		return 0;
+	}
+
+	return (_iq)((((unsigned long long)pulseClock * intervals) << QG) / ((unsigned long long)span * PULSE_EDGES_PER_M));
 }
 
 void isrPortF(void)
 {
+	// Get Current Time first to minimise jitter
+	unsigned long newPulseTime = TimerValueGet(PULSE_TIMER_BASE, TIMER_A);
+
 	// Clear Interrupt Flag
 	GPIOPinIntClear (GPIO_PORTF_BASE, 0xFF);
 
-	// Get Current Time
-	TickType_t newPulseTick = xTaskGetTickCountFromISR();
-
-	// Store Pulse Length
-	lastTickDuration = newPulseTick - lastPulseTick;
-
-	// Store Current Time
-	lastPulseTick = newPulseTick;
+	// Store Pulse Time
+	edgeTimes[edgeIndex] = newPulseTime;
+	edgeIndex = (edgeIndex + 1) % PULSE_RING_SIZE;
+	if (edgeCount < PULSE_RING_SIZE)
+	{
+		edgeCount++;
+	}
 }
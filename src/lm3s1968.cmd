@@ -10,7 +10,8 @@
 
 MEMORY
 {
-    FLASH (RX) : origin = 0x00000000, length = 0x00040000
+    /* the last 2K is reserved for the calibration parameter blocks */
+    FLASH (RX) : origin = 0x00000000, length = 0x0003F800
     SRAM (RWX) : origin = 0x20000000, length = 0x00010000
 }
 
@@ -26,6 +26,7 @@
 
 #include "shared_adc.h"
 #include "shared_parameters.h"
+#include "shared_calibration.h"
 
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
@@ -122,22 +123,48 @@ void initAdcModule(char adcs)
 }
 
 
-_iq getSmoothAdc(char adc, _iq minValue, _iq maxValue)
+/**
+ * \brief Gets the ADCout index of an ADC.
+ *
+ * \param adc The ADC.
+ * \return The index, -1 for bad input.
+ */
+static int getAdcIndex(char adc)
 {
-	unsigned long adcOutput;
-
 	switch (adc)
 	{
 	case 0x01:
-		adcOutput = ADCout[0] & ADC_DATA_MASK; break;
+		return 0;
 	case 0x02:
-		adcOutput = ADCout[1] & ADC_DATA_MASK; break;
+		return 1;
 	case 0x04:
-		adcOutput = ADCout[2] & ADC_DATA_MASK; break;
+		return 2;
 	default:
+		return -1;
+	}
+}
+
+unsigned long getRawAdc(char adc)
+{
+	int index = getAdcIndex(adc);
+	if (index < 0)
+	{
+		return 0;
+	}
+
+	return ADCout[index] & ADC_DATA_MASK;
+}
+
+_iq getSmoothAdc(char adc, _iq minValue, _iq maxValue)
+{
+	int index = getAdcIndex(adc);
+	if (index < 0)
+	{
 		return -1ul;
 	}
 
+	unsigned long adcOutput = getCalibratedAdc(index, ADCout[index] & ADC_DATA_MASK);
+
 	return minValue + _IQmpy((maxValue - minValue), ADC_TO_IQ(adcOutput));
 }
 
@@ -0,0 +1,293 @@
+/**
+ * \file shared_calibration.c
+ * \brief Common module for calibrating the PWM to ADC links between the boards.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-16
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_calibration.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "inc/hw_types.h"
+#include "driverlib/flash.h"
+#include "driverlib/sysctl.h"
+#include "utils/flash_pb.h"
+
+#include "shared_adc.h"
+#include "shared_link_stats.h"
+#include "shared_uart_task.h"
+
+#define CALIBRATION_FLASH_START 0x3F800   /**< Start of the parameter block flash, reserved in the linker scripts. */
+#define CALIBRATION_FLASH_END 0x40000     /**< End of the parameter block flash. */
+#define CALIBRATION_BLOCK_SIZE 128        /**< Size of a parameter block, must divide the 1K erase size. */
+#define CALIBRATION_VERSION 1             /**< Bumped when the block layout changes. */
+
+#define CALIBRATION_SETTLE_MS 80          /**< Time for the RC filter to settle before a point is read. */
+#define CALIBRATION_HOLD_MS 20            /**< Time a point is held after it has been announced. */
+
+#define SEGMENT_SHIFT 6                   /**< log2 of the ideal ADC counts per segment. */
+#define SLOPE_SHIFT 16                    /**< Fractional bits of the segment slopes. */
+#define ADC_MAX_CODE 0x3FF
+
+/**
+ * \struct CalibrationBlock
+ * \brief Layout of the flash parameter block, the first two bytes belong to flash_pb.
+ */
+typedef struct
+{
+	unsigned char sequence;                                         /**<flash_pb sequence number */
+	unsigned char checksum;                                         /**<flash_pb checksum */
+	unsigned char version;                                          /**<CALIBRATION_VERSION */
+	unsigned char validChannels;                                    /**<bit set for each calibrated channel */
+	unsigned short measured[CALIBRATION_CHANNELS][CALIBRATION_POINTS]; /**<raw ADC reading at each sweep point */
+} CalibrationBlock;
+
+/**
+ * \union CalibrationBuffer
+ * \brief Pads the block to the parameter block size.
+ */
+typedef union
+{
+	CalibrationBlock block;
+	unsigned char bytes[CALIBRATION_BLOCK_SIZE];
+} CalibrationBuffer;
+
+static CalibrationBuffer calibration;  /**< The active calibration, also the recording buffer. */
+static unsigned long slope[CALIBRATION_CHANNELS][CALIBRATION_SEGMENTS]; /**< Ideal counts per measured count. */
+static unsigned char validChannels;    /**< Channels with a usable table. */
+static volatile int savePending;       /**< Set when a new table is waiting to be written to flash. */
+
+static volatile int sweepPoint = -1;   /**< The point being output, -1 when not sweeping. */
+static TickType_t pointStartTick;
+static int pointAnnounced;
+
+/**
+ * \brief Precomputes the segment slopes so correcting needs no division.
+ *
+ * \param block The measured table.
+ * \return Bit set for every channel that is monotonic and so usable.
+ */
+static unsigned char buildTables(const CalibrationBlock *block)
+{
+	unsigned char valid = 0;
+	unsigned int ch;
+	unsigned int k;
+
+	for (ch = 0; ch < CALIBRATION_CHANNELS; ch++)
+	{
+		if (!(block->validChannels & (1 << ch)))
+		{
+			continue;
+		}
+
+		for (k = 0; k < CALIBRATION_SEGMENTS; k++)
+		{
+			long span = (long)block->measured[ch][k + 1] - block->measured[ch][k];
+			if (span <= 0)
+			{
+				break;  // not monotonic, the link is not connected
+			}
+			slope[ch][k] = ((unsigned long)(1 << SEGMENT_SHIFT) << SLOPE_SHIFT) / span;
+		}
+
+		if (k == CALIBRATION_SEGMENTS)
+		{
+			valid |= 1 << ch;
+		}
+	}
+
+	return valid;
+}
+
+/**
+ * \brief Handles a CALIBRATION_MSG frame from the other board.
+ *
+ * \param uartFrame The received frame.
+ */
+static void readCalibrationMessage(UartFrame *uartFrame)
+{
+	recordCalibrationPoint(uartFrame->frameWise.msg[0]);
+}
+
+void initCalibration(void)
+{
+	registerMsgType(CALIBRATION_MSG, CALIBRATION_MSG_LEN, 1, readCalibrationMessage);
+
+	FlashUsecSet(SysCtlClockGet() / 1000000);
+	FlashPBInit(CALIBRATION_FLASH_START, CALIBRATION_FLASH_END, CALIBRATION_BLOCK_SIZE);
+
+	unsigned char *stored = FlashPBGet();
+	if (stored != NULL && ((CalibrationBlock *)stored)->version == CALIBRATION_VERSION)
+	{
+		unsigned int i;
+		for (i = 0; i < CALIBRATION_BLOCK_SIZE; i++)
+		{
+			calibration.bytes[i] = stored[i];
+		}
+		validChannels = buildTables(&calibration.block);
+	}
+	else
+	{
+		validChannels = 0;
+	}
+}
+
+void startCalibrationSweep(void)
+{
+	pointStartTick = xTaskGetTickCount();
+	pointAnnounced = 0;
+	sweepPoint = 0;
+}
+
+int updateCalibrationSweep(void)
+{
+	if (sweepPoint < 0)
+	{
+		return -1;
+	}
+
+	TickType_t elapsed = xTaskGetTickCount() - pointStartTick;
+
+	if (!pointAnnounced && elapsed >= CALIBRATION_SETTLE_MS * configTICK_RATE_HZ / 1000)
+	{
+		// output has settled, tell the other board to read it
+		UartFrame *pointSend = claimMsgToSend();
+		if (pointSend != NULL)
+		{
+			pointSend->frameWise.msgType = CALIBRATION_MSG;
+			pointSend->frameWise.msg[0] = (char)sweepPoint;
+			commitBinaryMsgToSend(pointSend);
+			pointAnnounced = 1;
+		}
+	}
+	else if (pointAnnounced && elapsed >= (CALIBRATION_SETTLE_MS + CALIBRATION_HOLD_MS) * configTICK_RATE_HZ / 1000)
+	{
+		pointStartTick += elapsed;
+		pointAnnounced = 0;
+		sweepPoint++;
+		if (sweepPoint >= CALIBRATION_POINTS)
+		{
+			sweepPoint = -1;
+		}
+	}
+
+	return sweepPoint;
+}
+
+int getCalibrationSweeping(void)
+{
+	return sweepPoint >= 0;
+}
+
+void setCalibrationSweeping(int sweep)
+{
+	if (sweep)
+	{
+		startCalibrationSweep();
+	}
+	else
+	{
+		sweepPoint = -1;
+	}
+}
+
+void recordCalibrationPoint(int point)
+{
+	static const char adcs[CALIBRATION_CHANNELS] = {0x01, 0x02, 0x04};
+	unsigned int ch;
+
+	if (point < 0 || point >= CALIBRATION_POINTS)
+	{
+		return;
+	}
+
+	if (point == 0)
+	{
+		// stop correcting while the new table is recorded
+		validChannels = 0;
+		calibration.block.validChannels = (1 << CALIBRATION_CHANNELS) - 1;
+	}
+
+	for (ch = 0; ch < CALIBRATION_CHANNELS; ch++)
+	{
+		calibration.block.measured[ch][point] = getRawAdc(adcs[ch]);
+	}
+
+	if (point == CALIBRATION_POINTS - 1)
+	{
+		calibration.block.version = CALIBRATION_VERSION;
+		calibration.block.validChannels = buildTables(&calibration.block);
+		validChannels = calibration.block.validChannels;
+
+		// writing flash takes milliseconds, too long to hold up the UART task
+		savePending = 1;
+	}
+}
+
+void saveCalibration(void)
+{
+	if (savePending)
+	{
+		savePending = 0;
+
+		// every interrupt stalls while flash is written, so received bytes are lost and counted
+		setUartPaused(1);
+		linkStatsFlashPause();
+		FlashPBSave(calibration.bytes);
+		setUartPaused(0);
+	}
+}
+
+unsigned long getCalibratedAdc(unsigned int channel, unsigned long raw)
+{
+	if (!(validChannels & (1 << channel)))
+	{
+		return raw;
+	}
+
+	const unsigned short *measured = calibration.block.measured[channel];
+	if (raw <= measured[0])
+	{
+		return 0;
+	}
+
+	// the link is close to linear so the ideal segment is a good first guess
+	unsigned int k = raw >> SEGMENT_SHIFT;
+	if (k >= CALIBRATION_SEGMENTS)
+	{
+		k = CALIBRATION_SEGMENTS - 1;
+	}
+	while (k > 0 && raw < measured[k])
+	{
+		k--;
+	}
+	while (k < CALIBRATION_SEGMENTS - 1 && raw >= measured[k + 1])
+	{
+		k++;
+	}
+
+	unsigned long corrected = (k << SEGMENT_SHIFT) + (((raw - measured[k]) * slope[channel][k]) >> SLOPE_SHIFT);
+
+	return corrected > ADC_MAX_CODE ? ADC_MAX_CODE : corrected;
+}
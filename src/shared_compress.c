@@ -0,0 +1,210 @@
+/**
+ * \file shared_compress.c
+ * \brief Common streaming compressor for records of fixed point signal samples.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_compress.h"
+
+#include <stddef.h>
+
+#define VARINT_CONTINUE 0x80
+#define VARINT_BITS 7
+
+/**
+ * \brief Writes a varint with a flag in the lowest bit, so one more bit than the value.
+ *
+ * \param out Where to write
+ * \param value The value
+ * \param flag The flag bit, only written in run-length mode
+ * \param flagged Whether to include the flag bit
+ * \return Number of bytes written
+ */
+static unsigned int putVarint(unsigned char *out, uint32_t value, unsigned int flag, int flagged)
+{
+	unsigned int length = 0;
+	unsigned int firstBits = flagged ? VARINT_BITS - 1 : VARINT_BITS;
+	unsigned char byte = flagged ? ((value << 1) | flag) & 0x7F : value & 0x7F;
+
+	value >>= firstBits;
+	while (value)
+	{
+		out[length++] = byte | VARINT_CONTINUE;
+		byte = value & 0x7F;
+		value >>= VARINT_BITS;
+	}
+	out[length++] = byte;
+
+	return length;
+}
+
+/**
+ * \brief Reads a varint written by putVarint().
+ *
+ * \param in The bytes
+ * \param length Number of bytes available
+ * \param value Where to write the value
+ * \param flag Where to write the flag bit, NULL if not flagged
+ * \return Number of bytes consumed, 0 if truncated
+ */
+static unsigned int getVarint(const unsigned char *in, unsigned int length, uint32_t *value, unsigned int *flag)
+{
+	unsigned int consumed = 0;
+	unsigned int shift;
+	uint32_t result;
+
+	if (length == 0)
+	{
+		return 0;
+	}
+
+	if (flag)
+	{
+		*flag = in[0] & 1;
+		result = (in[0] & 0x7F) >> 1;
+		shift = VARINT_BITS - 1;
+	}
+	else
+	{
+		result = in[0] & 0x7F;
+		shift = VARINT_BITS;
+	}
+
+	while (in[consumed++] & VARINT_CONTINUE)
+	{
+		if (consumed >= length || consumed >= COMPRESS_MAX_VARINT)
+		{
+			return 0;
+		}
+		result |= (uint32_t)(in[consumed] & 0x7F) << shift;
+		shift += VARINT_BITS;
+	}
+
+	*value = result;
+	return consumed;
+}
+
+void compressorInit(Compressor *compressor, unsigned int channels, int runLength)
+{
+	unsigned int channel;
+
+	compressor->channels = channels > COMPRESS_MAX_CHANNELS ? COMPRESS_MAX_CHANNELS : channels;
+	compressor->runLength = runLength;
+	for (channel = 0; channel < COMPRESS_MAX_CHANNELS; channel++)
+	{
+		compressor->last[channel] = 0;
+	}
+}
+
+void compressorSetLast(Compressor *compressor, const int32_t *values)
+{
+	unsigned int channel;
+
+	for (channel = 0; channel < compressor->channels; channel++)
+	{
+		compressor->last[channel] = values[channel];
+	}
+}
+
+unsigned int compressRecord(Compressor *compressor, const int32_t *values, unsigned char *out)
+{
+	unsigned int length = 0;
+	unsigned int run = 0;
+	unsigned int channel;
+
+	for (channel = 0; channel < compressor->channels; channel++)
+	{
+		// wrapping difference, then zig-zag so the sign ends up in the lowest bit
+		uint32_t delta = (uint32_t)values[channel] - (uint32_t)compressor->last[channel];
+		uint32_t zigzag = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+		compressor->last[channel] = values[channel];
+
+		if (!compressor->runLength)
+		{
+			length += putVarint(&out[length], zigzag, 0, 0);
+		}
+		else if (zigzag == 0)
+		{
+			run++;
+		}
+		else
+		{
+			if (run)
+			{
+				length += putVarint(&out[length], run - 1, 1, 1);
+				run = 0;
+			}
+			length += putVarint(&out[length], zigzag, 0, 1);
+		}
+	}
+
+	if (run)
+	{
+		length += putVarint(&out[length], run - 1, 1, 1);
+	}
+
+	return length;
+}
+
+unsigned int decompressRecord(Compressor *compressor, const unsigned char *in, unsigned int length, int32_t *values)
+{
+	unsigned int consumed = 0;
+	unsigned int channel = 0;
+
+	while (channel < compressor->channels)
+	{
+		uint32_t value;
+		unsigned int flag = 0;
+		unsigned int used = getVarint(&in[consumed], length - consumed, &value, compressor->runLength ? &flag : NULL);
+
+		if (used == 0)
+		{
+			return 0;
+		}
+		consumed += used;
+
+		if (flag)
+		{
+			// a run of unchanged channels
+			if (value >= compressor->channels - channel)
+			{
+				return 0;
+			}
+			unsigned int run = value + 1;
+			while (run--)
+			{
+				values[channel] = compressor->last[channel];
+				channel++;
+			}
+		}
+		else
+		{
+			uint32_t delta = (value >> 1) ^ (0 - (value & 1));
+			values[channel] = (int32_t)((uint32_t)compressor->last[channel] + delta);
+			channel++;
+		}
+	}
+
+	compressorSetLast(compressor, values);
+	return consumed;
+}
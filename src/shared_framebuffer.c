@@ -0,0 +1,379 @@
+/**
+ * \file shared_framebuffer.c
+ * \brief Off-screen copy of the OLED display that is flushed to it in dirty rectangles
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_framebuffer.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+#include "inc/hw_types.h"
+#include "inc/hw_ints.h"
+#include "driverlib/interrupt.h"
+#include "drivers/rit128x96x4.h"
+
+#define WINDOW_COST 8   /**< Command bytes sent to set up a window on the display */
+#define GLYPHS 96       /**< Characters in the font, space to delete */
+#define GLYPH_BYTES (FRAMEBUFFER_GLYPH_WIDTH / 2) /**< Bytes across a character cell */
+
+/**
+ * \brief The font expanded to 4 bit pixels for one brightness
+ */
+typedef struct
+{
+	unsigned char level;                                             /**< Brightness of the lit pixels */
+	unsigned char glyphs[GLYPHS][GLYPH_BYTES][FRAMEBUFFER_GLYPH_HEIGHT]; /**< Bytes of each character cell, column by column */
+} GlyphCache;
+
+static unsigned char frame[FRAMEBUFFER_HEIGHT][FRAMEBUFFER_STRIDE]; /**< Starts blank, as the display is after initialising */
+static unsigned char dirtyFirst[FRAMEBUFFER_HEIGHT];   /**< First changed byte in each row */
+static unsigned char dirtyEnd[FRAMEBUFFER_HEIGHT];     /**< One past the last changed byte in each row, 0 if none changed */
+static unsigned char dirtyTop[FRAMEBUFFER_STRIDE];     /**< First changed row in each column of bytes */
+static unsigned char dirtyBottom[FRAMEBUFFER_STRIDE];  /**< One past the last changed row in each column of bytes, 0 if none changed */
+static GlyphCache glyphCaches[FRAMEBUFFER_CACHED_LEVELS];
+static unsigned int cachedLevels = 0;
+static SemaphoreHandle_t flushed = NULL;  /**< Given from the SSI interrupt when the display has been sent everything queued */
+
+/**
+ * \brief Called from the SSI interrupt when the queued windows have been sent
+ */
+static void flushDone(void)
+{
+	portBASE_TYPE higherPriorityTaskWoken = pdFALSE;
+	xSemaphoreGiveFromISR(flushed, &higherPriorityTaskWoken);
+	portEND_SWITCHING_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * \brief Sends a window of the frame to the display
+ *
+ * \param image First byte of the window in the frame
+ * \param x Column of the left of the window, even
+ * \param y Row of the top of the window
+ * \param width Columns in the window, even
+ * \param height Rows in the window
+ */
+static void sendWindow(const unsigned char *image, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+	if (flushed == NULL)
+	{
+		RIT128x96x4ImageWindowDraw(image, x, y, width, height, FRAMEBUFFER_STRIDE);
+		return;
+	}
+
+	while (!RIT128x96x4ImageWindowQueue(image, x, y, width, height, FRAMEBUFFER_STRIDE))
+	{
+		vTaskDelay(1); // queue full, let other tasks run while the interrupt drains it
+	}
+}
+
+/**
+ * \brief Expands a character of the font to the bytes of its cell
+ *
+ * \param glyph Font columns of the character, as from RIT128x96x4GlyphGet()
+ * \param level Brightness of the lit pixels
+ * \param cell Filled with the bytes of the cell, column by column
+ */
+static void expandGlyph(const unsigned char *glyph, unsigned char level, unsigned char cell[GLYPH_BYTES][FRAMEBUFFER_GLYPH_HEIGHT])
+{
+	unsigned int pair;
+	unsigned int row;
+
+	// the font has 5 columns, the sixth is the gap between characters
+	for (pair = 0; pair < GLYPH_BYTES; pair++)
+	{
+		unsigned char left = glyph[2 * pair];
+		unsigned char right = (2 * pair + 1 < 5) ? glyph[2 * pair + 1] : 0;
+		for (row = 0; row < FRAMEBUFFER_GLYPH_HEIGHT; row++)
+		{
+			unsigned char value = 0;
+			if (left & (1 << row))
+			{
+				value = level << 4;
+			}
+			if (right & (1 << row))
+			{
+				value |= level;
+			}
+			cell[pair][row] = value;
+		}
+	}
+}
+
+/**
+ * \brief Widens a span of changed bytes to take in another
+ *
+ * \param first First changed position
+ * \param end One past the last changed position, 0 if none changed
+ * \param position The position that changed
+ */
+static void widenSpan(unsigned char *first, unsigned char *end, unsigned int position)
+{
+	if (*end == 0)
+	{
+		*first = position;
+		*end = position + 1;
+	}
+	else if (position < *first)
+	{
+		*first = position;
+	}
+	else if (position >= *end)
+	{
+		*end = position + 1;
+	}
+}
+
+/**
+ * \brief Writes a byte of the frame, noting it if it changed
+ *
+ * \param row Row of the byte
+ * \param column Byte in the row
+ * \param value Two pixels, the left in the high nibble
+ */
+static void putByte(unsigned int row, unsigned int column, unsigned char value)
+{
+	if (frame[row][column] == value)
+	{
+		return;
+	}
+
+	frame[row][column] = value;
+	widenSpan(&dirtyFirst[row], &dirtyEnd[row], column);
+	widenSpan(&dirtyTop[column], &dirtyBottom[column], row);
+}
+
+/**
+ * \brief Covers the changed bytes with windows running along rows or down columns
+ *
+ * Each row, or column, of changes is sent together with the next while that costs less than
+ * starting another window.
+ *
+ * \param alongRows 1 to cover each row's span of changes, 0 to cover each column's
+ * \param send 1 to send the windows, 0 to only count what they would cost
+ * \return Number of bytes the windows cost to send, commands included
+ */
+static unsigned int coverChanges(int alongRows, int send)
+{
+	const unsigned char *first = alongRows ? dirtyFirst : dirtyTop;
+	const unsigned char *end = alongRows ? dirtyEnd : dirtyBottom;
+	unsigned int lines = alongRows ? FRAMEBUFFER_HEIGHT : FRAMEBUFFER_STRIDE;
+	unsigned int cost = 0;
+	unsigned int line = 0;
+
+	while (line < lines)
+	{
+		if (end[line] == 0)
+		{
+			line++;
+			continue;
+		}
+
+		// grow the window over the next lines while sending the union is cheaper than another window
+		unsigned int spanFirst = first[line];
+		unsigned int spanStop = end[line];
+		unsigned int next = line + 1;
+		while (next < lines && end[next] != 0)
+		{
+			unsigned int unionFirst = first[next] < spanFirst ? first[next] : spanFirst;
+			unsigned int unionStop = end[next] > spanStop ? end[next] : spanStop;
+			unsigned int merged = (unionStop - unionFirst) * (next - line + 1);
+			unsigned int separate = (spanStop - spanFirst) * (next - line) + WINDOW_COST + end[next] - first[next];
+			if (merged > separate)
+			{
+				break;
+			}
+			spanFirst = unionFirst;
+			spanStop = unionStop;
+			next++;
+		}
+
+		if (send && alongRows)
+		{
+			sendWindow(&frame[line][spanFirst], spanFirst * 2, line, (spanStop - spanFirst) * 2, next - line);
+		}
+		else if (send)
+		{
+			sendWindow(&frame[spanFirst][line], line * 2, spanFirst, (next - line) * 2, spanStop - spanFirst);
+		}
+		cost += WINDOW_COST + (spanStop - spanFirst) * (next - line);
+		line = next;
+	}
+
+	return cost;
+}
+
+int framebufferInit(void)
+{
+	flushed = xSemaphoreCreateBinary();
+	if (flushed == NULL)
+	{
+		return -1;
+	}
+
+	RIT128x96x4QueueInit(flushDone);
+	IntPrioritySet(INT_SSI0, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	return 0;
+}
+
+void framebufferWait(void)
+{
+	while (RIT128x96x4QueueBusy())
+	{
+		xSemaphoreTake(flushed, portMAX_DELAY);
+	}
+}
+
+void framebufferClear(void)
+{
+	unsigned int row;
+	unsigned int column;
+
+	for (row = 0; row < FRAMEBUFFER_HEIGHT; row++)
+	{
+		for (column = 0; column < FRAMEBUFFER_STRIDE; column++)
+		{
+			putByte(row, column, 0);
+		}
+	}
+}
+
+int framebufferCacheLevel(unsigned char level)
+{
+	unsigned int glyph;
+
+	if (cachedLevels >= FRAMEBUFFER_CACHED_LEVELS)
+	{
+		return -1;
+	}
+
+	GlyphCache *cache = &glyphCaches[cachedLevels];
+	cache->level = level & 0x0f;
+	for (glyph = 0; glyph < GLYPHS; glyph++)
+	{
+		expandGlyph(RIT128x96x4GlyphGet(' ' + glyph), cache->level, cache->glyphs[glyph]);
+	}
+	cachedLevels++;
+
+	return 0;
+}
+
+void framebufferStringDraw(const char *str, unsigned int x, unsigned int y, unsigned char level)
+{
+	unsigned char expanded[GLYPH_BYTES][FRAMEBUFFER_GLYPH_HEIGHT];
+	int cached = -1;
+	unsigned int i;
+	unsigned int pair;
+	unsigned int row;
+
+	x &= ~1u; // two pixels a byte
+	level &= 0x0f;
+
+	for (i = 0; i < cachedLevels; i++)
+	{
+		if (glyphCaches[i].level == level)
+		{
+			cached = i;
+		}
+	}
+
+	while (*str != '\0' && x < FRAMEBUFFER_WIDTH)
+	{
+		// characters outside space to delete are drawn as a space, as the driver does
+		unsigned char glyph = *str++ & 0x7f;
+		glyph = glyph < ' ' ? 0 : glyph - ' ';
+
+		const unsigned char (*cell)[FRAMEBUFFER_GLYPH_HEIGHT];
+		if (cached >= 0)
+		{
+			cell = glyphCaches[cached].glyphs[glyph];
+		}
+		else
+		{
+			expandGlyph(RIT128x96x4GlyphGet(' ' + glyph), level, expanded);
+			cell = (const unsigned char (*)[FRAMEBUFFER_GLYPH_HEIGHT])expanded;
+		}
+
+		for (pair = 0; pair < GLYPH_BYTES && x < FRAMEBUFFER_WIDTH; pair++, x += 2)
+		{
+			for (row = 0; row < FRAMEBUFFER_GLYPH_HEIGHT && y + row < FRAMEBUFFER_HEIGHT; row++)
+			{
+				putByte(y + row, x / 2, cell[pair][row]);
+			}
+		}
+	}
+}
+
+void framebufferImageDraw(const unsigned char *image, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+	unsigned int row;
+	unsigned int column;
+	unsigned int bytes = width / 2;
+
+	for (row = 0; row < height && y + row < FRAMEBUFFER_HEIGHT; row++)
+	{
+		for (column = 0; column < bytes && x / 2 + column < FRAMEBUFFER_STRIDE; column++)
+		{
+			putByte(y + row, x / 2 + column, image[row * bytes + column]);
+		}
+	}
+}
+
+void framebufferScroll(unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int distance)
+{
+	unsigned int row;
+	unsigned int column;
+	unsigned int first = x / 2;
+	unsigned int stop = (x + width) / 2;
+	unsigned int shift = distance / 2;
+
+	for (row = y; row < y + height && row < FRAMEBUFFER_HEIGHT; row++)
+	{
+		for (column = first; column < stop && column < FRAMEBUFFER_STRIDE; column++)
+		{
+			putByte(row, column, column + shift < stop ? frame[row][column + shift] : 0);
+		}
+	}
+}
+
+unsigned int framebufferFlush(void)
+{
+	// a change of text runs along rows, a change of a trace down columns
+	unsigned int alongRows = coverChanges(1, 0);
+	unsigned int downColumns = coverChanges(0, 0);
+	unsigned int sent = coverChanges(alongRows <= downColumns, 1);
+
+	unsigned int line;
+	for (line = 0; line < FRAMEBUFFER_HEIGHT; line++)
+	{
+		dirtyEnd[line] = 0;
+	}
+	for (line = 0; line < FRAMEBUFFER_STRIDE; line++)
+	{
+		dirtyBottom[line] = 0;
+	}
+
+	return sent;
+}
@@ -34,11 +34,17 @@
 #include "task.h"
 #include "shared_guilayout.h"
 #include "shared_displayformat128x96.h"
+#include "shared_framebuffer.h"
 
 #define INPUTEVENT_QUEUE_SIZE 10
-#define GUI_TASK_RATE_HZ 10
+#define GUI_TASK_RATE_HZ 20
 #define OLED_FREQ 1000000
 
+#define TRACE_COLUMNS (PX_HORZ / 2)  /**< The display packs two pixels into a byte, so traces are drawn two pixels wide */
+#define TRACE_TOP (TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP + 1)  /**< Highest row a trace is drawn on */
+#define TRACE_BOTTOM (TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP + TRACE_HEIGHT - 1)  /**< Lowest row a trace is drawn on */
+#define TRACE_TRIGGER_BRIGHTNESS 2  /**< Brightness of the line marking the trigger of a frozen capture */
+
 typedef enum {VERTDIR_UP, VERTDIR_DOWN} VertDir;
 typedef enum {HORZDIR_LEFT, HORZDIR_RIGHT} HorzDir;
 typedef enum {DRAWMODE_TITLE, DRAWMODE_OPTION} DrawMode;
@@ -49,8 +55,24 @@ typedef struct
 	ButtonEvent event;
 } InputEvent;
 
+/**
+ * \brief What the trace plot on screen was drawn from, so while it scrolls only new columns are drawn
+ */
+typedef struct
+{
+	const TraceView *view;     /**< View drawn, NULL if the plot must be drawn in full */
+	unsigned int scale;        /**< Horizontal scale drawn at */
+	tBoolean selected;         /**< Whether drawn selected */
+	TraceTriggerState trigger; /**< State of the buffer's trigger when drawn */
+	int latestStep;            /**< Step of the latest point drawn, see getTraceStep() */
+} PlottedTrace;
+
 static QueueHandle_t inputEventQueue;
 static Activity *unitActivity;
+static int drawnValues[LISTVIEW_MAX_ITEMS];     /**< Value each item of the ListView showing was last drawn with */
+static tBoolean drawnSelected[LISTVIEW_MAX_ITEMS]; /**< Whether each item of the ListView showing was last drawn selected */
+static volatile unsigned long displayBytesPerSecond = 0; /**< Bytes sent to the display over SSI in the last second */
+static PlottedTrace plotted;                      /**< Trace plot on screen */
 
 static char CLEAR_ROW[PX_HORZ] = "                      ";
 
@@ -131,13 +153,15 @@ void drawListViewItem(const Item *item, unsigned int index, tBoolean selected);
 void drawTraceViewPlot(const TraceView *view, tBoolean selected);
 
 /**
- * \brief Draws a single point on the display
+ * \brief Draws the y range of each channel in one column of a trace, clearing the rest of the column
  *
- * \param x Horizontal position to draw dot
- * \param y Vertical position to draw dot
- * \param level Brightness to draw dot
+ * \param column Column to draw, from the left
+ * \param top Highest row to light for each channel, rows outside the plot are clipped
+ * \param bottom Lowest row to light for each channel, above top to leave the channel out
+ * \param levels Brightness to draw each channel, earlier channels are drawn over later ones
+ * \param channels Number of channels, 0 to clear the column
  */
-void drawPointRtoL(unsigned int x, unsigned int y, char level);
+void drawTraceColumn(unsigned int column, const int *top, const int *bottom, const char *levels, unsigned int channels);
 
 /**
  * \brief Clears the trace plot for a new trace
@@ -171,6 +195,11 @@ void attachActivity(Activity *activity)
 	unitActivity = activity;
 }
 
+int getDisplayBytesPerSecond(void)
+{
+	return displayBytesPerSecond;
+}
+
 int queueInputEvent(Button button, ButtonEvent event)
 {
 	InputEvent inputEvent;
@@ -204,13 +233,21 @@ void vGuiRefreshTask(void *pvParameters)
 
 	// initialize screen
 	RIT128x96x4Init(OLED_FREQ);
+	framebufferInit();
+	framebufferCacheLevel(SELECTED_BRIGHTNESS);
+	framebufferCacheLevel(UNSELECTED_BRIGHTNESS);
 	redrawView(unitActivity);
+	unsigned long displayBytes = framebufferFlush();
+	unsigned int cycles = 0;
 
 	for (;;)
 	{
 		// wait for next cycle
 		vTaskDelayUntil(&xLastWakeTime, xTimeIncrement);
 
+		// the display is sent from the frame buffer, so let the last flush finish before drawing
+		framebufferWait();
+
 		// updates read only values
 		refreshReadonlyValues(unitActivity);
 
@@ -253,6 +290,15 @@ void vGuiRefreshTask(void *pvParameters)
 				}
 			}
 		}
+
+		// send what changed this cycle in one go
+		displayBytes += framebufferFlush();
+		if (++cycles >= GUI_TASK_RATE_HZ)
+		{
+			displayBytesPerSecond = displayBytes;
+			displayBytes = 0;
+			cycles = 0;
+		}
 	}
 }
 
@@ -436,13 +482,16 @@ void refreshReadonlyValues(const Activity *activity)
 	if (activity->menuTypes[activity->pageContext] == VIEWTYPE_LIST)
 	{
 		ListView *listView = (ListView *)activity->menus[activity->pageContext];
-		// Redraw items that are read-only only
+		// Redraw read-only items that changed since they were drawn
 		for (i = 0; i<listView->numItems; i++)
 		{
 			if (listView->items[i].accessType == OPTIONACCESS_READONLY)
 			{
 				tBoolean selected = (activity->cursorContext - 1) == i;
-				drawListViewItem(&(((ListView *)listView)->items[i]), i, selected);
+				if (listView->items[i].getter() != drawnValues[i] || selected != drawnSelected[i])
+				{
+					drawListViewItem(&(((ListView *)listView)->items[i]), i, selected);
+				}
 			}
 		}
 	}
@@ -457,7 +506,7 @@ void refreshReadonlyValues(const Activity *activity)
 
 void redrawListView(const Activity *activity)
 {
-	RIT128x96x4Clear();
+	framebufferClear();
 
 	// draw title (is selected when coming to new page)
 	drawViewTitle(activity);
@@ -473,7 +522,8 @@ void redrawListView(const Activity *activity)
 
 void redrawTraceView(const Activity *activity)
 {
-	RIT128x96x4Clear();
+	framebufferClear();
+	plotted.view = NULL;
 
 	// draw title (is selected when coming to new page)
 	drawViewTitle(activity);
@@ -484,7 +534,7 @@ void redrawTraceView(const Activity *activity)
 
 void drawViewTitle(const Activity *activity)
 {
-	RIT128x96x4StringDraw(CLEAR_ROW, 0, TITLE_PADDINGTOP, 0);
+	framebufferStringDraw(CLEAR_ROW, 0, TITLE_PADDINGTOP, 0);
 
 	// draw title
 	char titleStr[VIEW_NAME_SIZE];
@@ -494,27 +544,27 @@ void drawViewTitle(const Activity *activity)
 	if (activity->cursorContext == 0)
 	{
 		// title selected, draw bright
-		RIT128x96x4StringDraw(titleStr, posX, TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
+		framebufferStringDraw(titleStr, posX, TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
 		if (activity->pageContext > 0)
 		{
-			RIT128x96x4StringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_LEFT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
+			framebufferStringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_LEFT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
 		}
 		if (activity->pageContext < activity->numPages - 1)
 		{
-			RIT128x96x4StringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_RIGHT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
+			framebufferStringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_RIGHT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, SELECTED_BRIGHTNESS);
 		}
 	}
 	else
 	{
 		// title not selected, draw dim
-		RIT128x96x4StringDraw(titleStr, posX, TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
+		framebufferStringDraw(titleStr, posX, TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
 		if (activity->pageContext > 0)
 		{
-			RIT128x96x4StringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_LEFT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
+			framebufferStringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_LEFT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
 		}
 		if (activity->pageContext < activity->numPages - 1)
 		{
-			RIT128x96x4StringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_RIGHT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
+			framebufferStringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_TITLE, HORZDIR_RIGHT, posX, ustrlen(titleStr)), TITLE_PADDINGTOP, UNSELECTED_BRIGHTNESS);
 		}
 	}
 }
@@ -524,37 +574,40 @@ void drawListViewItem(const Item *item, unsigned int index, tBoolean selected)
 	// draw item label
 	unsigned int posX = getHorzAlignment(item->name, ITEM_TEXTALIGN, ITEM_MARGIN);
 	unsigned int posY = TITLE_PADDINGTOP + TITLE_ITEM_SEP + index * ITEM_HEIGHT;
-	RIT128x96x4StringDraw(CLEAR_ROW, 0, posY, 0);
+	framebufferStringDraw(CLEAR_ROW, 0, posY, 0);
 	if (selected)
 	{
-		RIT128x96x4StringDraw(item->name, posX, posY, SELECTED_BRIGHTNESS);
+		framebufferStringDraw(item->name, posX, posY, SELECTED_BRIGHTNESS);
 	}
 	else
 	{
-		RIT128x96x4StringDraw(item->name, posX, posY, UNSELECTED_BRIGHTNESS);
+		framebufferStringDraw(item->name, posX, posY, UNSELECTED_BRIGHTNESS);
 	}
 
 	// draw item option
+	int value = item->getter();
 	char buffer[OPTION_NAME_SIZE];
 	char *displayStr;
 	switch (item->optionType)
 	{
 	case (OPTIONTYPE_INT):
-		usprintf(buffer, "%4d\0", item->getter());
+		usprintf(buffer, "%4d\0", value);
 		displayStr = buffer;
 		break;
 	case (OPTIONTYPE_STRING):
-		displayStr = item->options.values[item->getter()];
+		displayStr = item->options.values[value];
 		break;
 	}
+	drawnValues[index] = value;
+	drawnSelected[index] = selected;
 	posX = getHorzAlignment(displayStr, OPTION_TEXTALIGN, OPTION_MARGIN);
 	if (selected)
 	{
-		RIT128x96x4StringDraw(displayStr, posX, posY, SELECTED_BRIGHTNESS);
+		framebufferStringDraw(displayStr, posX, posY, SELECTED_BRIGHTNESS);
 	}
 	else
 	{
-		RIT128x96x4StringDraw(displayStr, posX, posY, UNSELECTED_BRIGHTNESS);
+		framebufferStringDraw(displayStr, posX, posY, UNSELECTED_BRIGHTNESS);
 	}
 
 	// indicate whether option is modifiable
@@ -562,98 +615,209 @@ void drawListViewItem(const Item *item, unsigned int index, tBoolean selected)
 	{
 		if (selected)
 		{
-			if (item->getter() < item->options.maxIndex)
+			if (value < item->options.maxIndex)
 			{
-				RIT128x96x4StringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_RIGHT, posX, ustrlen(displayStr)), posY, SELECTED_BRIGHTNESS);
+				framebufferStringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_RIGHT, posX, ustrlen(displayStr)), posY, SELECTED_BRIGHTNESS);
 			}
-			if (item->getter() > item->options.minIndex)
+			if (value > item->options.minIndex)
 			{
-				RIT128x96x4StringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_LEFT, posX, ustrlen(displayStr)), posY, SELECTED_BRIGHTNESS);
+				framebufferStringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_LEFT, posX, ustrlen(displayStr)), posY, SELECTED_BRIGHTNESS);
 			}
 		}
 		else
 		{
-			if (item->getter() < item->options.maxIndex)
+			if (value < item->options.maxIndex)
 			{
-				RIT128x96x4StringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_RIGHT, posX, ustrlen(displayStr)), posY, UNSELECTED_BRIGHTNESS);
+				framebufferStringDraw(">", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_RIGHT, posX, ustrlen(displayStr)), posY, UNSELECTED_BRIGHTNESS);
 			}
-			if (item->getter() > item->options.minIndex)
+			if (value > item->options.minIndex)
 			{
-				RIT128x96x4StringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_LEFT, posX, ustrlen(displayStr)), posY, UNSELECTED_BRIGHTNESS);
+				framebufferStringDraw("<", getModifiableIndicatorHorzPos(DRAWMODE_OPTION, HORZDIR_LEFT, posX, ustrlen(displayStr)), posY, UNSELECTED_BRIGHTNESS);
 			}
 		}
 	}
 }
 
-void drawTraceViewPlot(const TraceView *view, tBoolean selected)
+/**
+ * \brief Gets which column of all those a trace could be drawn in a point falls in
+ *
+ * Columns are fixed to x rather than to the latest point, so while the trace scrolls each point
+ * stays in its column and the plot moves a whole column at a time.
+ *
+ * \param x Position of the point
+ * \param scale Change in x per pixel
+ * \return The column, counting from x = 0
+ */
+static int getTraceStep(int x, unsigned int scale)
 {
-	unsigned char brightness = selected ? SELECTED_BRIGHTNESS : UNSELECTED_BRIGHTNESS;
+	int width = 2 * (int)scale; // a column is a byte of two pixels
+	return x >= 0 ? x / width : -((width - 1 - x) / width);
+}
 
-	TraceNode *plotting = getLatestNode(view->buffer);
-	int headX = plotting->x;    // latest node appears rightmost of the trace
-	int headY = plotting->y;
+/**
+ * \brief Gets the column a point of a trace is drawn in
+ *
+ * \param x Position of the point
+ * \param latestStep Step of the latest point, which is drawn in the rightmost column
+ * \param scale Change in x per pixel
+ * \return The column, negative if the point is off the left of the screen
+ */
+static int getTraceColumn(int x, int latestStep, unsigned int scale)
+{
+	int column = TRACE_COLUMNS - 1 - (latestStep - getTraceStep(x, scale));
+	return column < 0 ? -1 : column;
+}
 
-	static int prevYPos[PX_HORZ];
-	int dispPosX = (plotting->x - headX) / ((int)view->dispHorzScale) + (PX_HORZ - 2);
-	int dispPosY;
-	if (view->dynamicZero)
+void drawTraceViewPlot(const TraceView *view, tBoolean selected)
+{
+	char levels[TRACE_MAX_CHANNELS + 1];
+	int zeroY[TRACE_MAX_CHANNELS];
+	int columnMin[TRACE_MAX_CHANNELS];
+	int columnMax[TRACE_MAX_CHANNELS];
+	int top[TRACE_MAX_CHANNELS + 1];          // room for the trigger marker under the channels
+	int bottom[TRACE_MAX_CHANNELS + 1];
+	unsigned int channels = view->buffer->levels[0].channels;
+	unsigned int channel;
+
+	// zoomed out, plot from the coarsest summary level no wider than a column so spikes still show
+	unsigned int level = compactTraceLevelFor(view->buffer, 2 * view->dispHorzScale);
+
+	TraceCursor plotting;
+	if (traceCursorLatest(&plotting, view->buffer, 0) != 0)
 	{
-		dispPosY = view->zeroLine - ((plotting->y - headY) * CHAR_HEIGHT) / (view->vertScale);
+		return; // nothing to draw yet
 	}
-	else
+	for (channel = 0; channel < channels; channel++)
 	{
-		dispPosY = view->zeroLine - (plotting->y * CHAR_HEIGHT) / (view->vertScale);
+		// latest sample appears rightmost of the trace
+		zeroY[channel] = view->dynamicZero ? plotting.min[channel] : 0;
+		levels[channel] = selected ? view->channelBrightness[channel] : view->channelBrightness[channel] * UNSELECTED_BRIGHTNESS / SELECTED_BRIGHTNESS;
+	}
+	traceCursorLatest(&plotting, view->buffer, level);
+	int latestStep = getTraceStep(plotting.latestX, view->dispHorzScale);
+	TraceTriggerState trigger = view->buffer->trigger.state;
+
+	// while only new points came in shift the plot along and draw the columns they fall in, and the
+	// rightmost column drawn before as it may have been part way through
+	int firstColumn = 0;
+	int shift = latestStep - plotted.latestStep;
+	if (plotted.view == view && plotted.scale == view->dispHorzScale && plotted.selected == selected
+			&& plotted.trigger == trigger && !view->dynamicZero && shift >= 0 && shift < TRACE_COLUMNS)
+	{
+		if (shift > 0)
+		{
+			framebufferScroll(0, TRACE_TOP, PX_HORZ, TRACE_BOTTOM - TRACE_TOP + 1, 2 * shift);
+		}
+		firstColumn = TRACE_COLUMNS - 1 - shift;
+	}
+	plotted.view = view;
+	plotted.scale = view->dispHorzScale;
+	plotted.selected = selected;
+	plotted.trigger = trigger;
+	plotted.latestStep = latestStep;
+
+	// mark where a frozen capture triggered with a dim line
+	int triggerColumn = -1;
+	if (trigger == TRIGGER_FROZEN)
+	{
+		triggerColumn = getTraceColumn(view->buffer->trigger.x, latestStep, view->dispHorzScale);
+		top[channels] = TRACE_TOP;
+		bottom[channels] = TRACE_BOTTOM;
+		levels[channels] = TRACE_TRIGGER_BRIGHTNESS;
 	}
 
-	// draw until screen is full or up to one being written,
-	// note: return value of getLatestNode() will change while buffer is being drawn
-	do
+	int column = getTraceColumn(plotting.latestX + plotting.x, latestStep, view->dispHorzScale);
+	int clearing;
+	for (clearing = TRACE_COLUMNS - 1; clearing > column; clearing--)
 	{
-		if ((dispPosY > (TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP)) && (dispPosY < (TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP + TRACE_HEIGHT)))
+		drawTraceColumn(clearing, NULL, NULL, NULL, 0);
+	}
+	for (channel = 0; channel < channels; channel++)
+	{
+		columnMin[channel] = plotting.min[channel];
+		columnMax[channel] = plotting.max[channel];
+	}
+
+	// draw until screen is full or up to the buckets being overwritten,
+	// merging the one or two buckets that fall in each column
+	for (;;)
+	{
+		int more = (traceCursorPrev(&plotting) == 0);
+		int nextColumn = more ? getTraceColumn(plotting.latestX + plotting.x, latestStep, view->dispHorzScale) : -1;
+		if (more && nextColumn == column)
 		{
-			drawPointRtoL(dispPosX, prevYPos[dispPosX], 0); // clear the previous dot in this x position
-			prevYPos[dispPosX] = dispPosY;                  // store the current dot position to clear next time
-			drawPointRtoL(dispPosX, dispPosY, brightness);
+			for (channel = 0; channel < channels; channel++)
+			{
+				if (plotting.min[channel] < columnMin[channel])
+				{
+					columnMin[channel] = plotting.min[channel];
+				}
+				if (plotting.max[channel] > columnMax[channel])
+				{
+					columnMax[channel] = plotting.max[channel];
+				}
+			}
+			continue;
 		}
 
-		plotting = plotting->prev;  // draw the previous node
+		for (channel = 0; channel < channels; channel++)
+		{
+			top[channel] = view->zeroLine - ((columnMax[channel] - zeroY[channel]) * CHAR_HEIGHT) / (view->vertScale);
+			bottom[channel] = view->zeroLine - ((columnMin[channel] - zeroY[channel]) * CHAR_HEIGHT) / (view->vertScale);
+		}
+		drawTraceColumn(column, top, bottom, levels, column == triggerColumn ? channels + 1 : channels);
 
-		dispPosX = (plotting->x - headX) / ((int)view->dispHorzScale) + (PX_HORZ - 1);
-		if (view->dynamicZero)
+		// clear columns no bucket fell in
+		for (column--; column > nextColumn && column >= firstColumn; column--)
 		{
-			dispPosY = view->zeroLine - ((plotting->y - headY) * CHAR_HEIGHT) / (view->vertScale);
+			drawTraceColumn(column, NULL, NULL, NULL, 0);
 		}
-		else
+		if (column < firstColumn)
 		{
-			dispPosY = view->zeroLine - (plotting->y * CHAR_HEIGHT) / (view->vertScale);
+			break;
 		}
 
+		for (channel = 0; channel < channels; channel++)
+		{
+			columnMin[channel] = plotting.min[channel];
+			columnMax[channel] = plotting.max[channel];
+		}
 	}
-	while (plotting != NULL && dispPosX >= 0 && plotting != getLatestNode(view->buffer));
-
 }
 
-void drawPointRtoL(unsigned int x, unsigned int y, char level)
+void drawTraceColumn(unsigned int column, const int *top, const int *bottom, const char *levels, unsigned int channels)
 {
-	if (level > MAX_BRIGHT_LEVEL)
+	static unsigned char image[TRACE_BOTTOM - TRACE_TOP + 1];
+	unsigned int channel;
+	int row;
+
+	// the whole column, only the rows that changed are flushed
+	for (row = TRACE_TOP; row <= TRACE_BOTTOM; row++)
 	{
-		level = MAX_BRIGHT_LEVEL; // limit brightness
+		char level = 0;
+		for (channel = 0; channel < channels; channel++)
+		{
+			if (row >= top[channel] && row <= bottom[channel])
+			{
+				level = levels[channel] > MAX_BRIGHT_LEVEL ? MAX_BRIGHT_LEVEL : levels[channel]; // limit brightness
+				break;
+			}
+		}
+		image[row - TRACE_TOP] = level | (level << 4);
 	}
-	unsigned char dot[1];
-	dot[0] = level | (level << 4);
-
-	RIT128x96x4ImageDraw(dot, x, y, 2, 1); // draw do
+	framebufferImageDraw(image, column * 2, TRACE_TOP, 2, TRACE_BOTTOM - TRACE_TOP + 1);
 }
 
 void clearTracePlot(void)
 {
 	unsigned int i = 0;
+	plotted.view = NULL;
 	for (i = TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP; i<TITLE_PADDINGTOP + CHAR_HEIGHT + TITLE_TRACE_SEP + TRACE_HEIGHT; i += CHAR_HEIGHT)
 	{
 		unsigned int j = 0;
 		for (j = 0; j<PX_HORZ; j += CHAR_WIDTH)
 		{
-			RIT128x96x4StringDraw(" ", j, i, 0);
+			framebufferStringDraw(" ", j, i, 0);
 		}
 	}
 }
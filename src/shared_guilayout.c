@@ -54,12 +54,12 @@ Item item(char *name, OptionType optionType, OptionAccess accessType, Options op
 	return item;
 }
 
-TraceView traceView(char *name, CircularBufferHandler *buffer, int zeroHeight, unsigned int minHorzScale, unsigned int maxHorzScale, int vertScale)
+TraceView traceView(char *name, CompactTraceBuffer *buffer, int zeroHeight, unsigned int minHorzScale, unsigned int maxHorzScale, int vertScale)
 {
 	TraceView traceView;
 
 	traceView.buffer = buffer;
-	traceView.horzScaleStep = 1;
+	traceView.horzScaleStep = minHorzScale > 0 ? minHorzScale : 1; // each press zooms by the finest scale
 	traceView.minZoomHorzScale = minHorzScale;
 	if (maxHorzScale < minHorzScale)
 	{
@@ -91,6 +91,13 @@ TraceView traceView(char *name, CircularBufferHandler *buffer, int zeroHeight, u
 
 	traceView.vertScale = vertScale;
 
+	const char brightness[TRACE_MAX_CHANNELS] = TRACE_CHANNEL_BRIGHTNESS;
+	unsigned int channel;
+	for (channel = 0; channel < TRACE_MAX_CHANNELS; channel++)
+	{
+		traceView.channelBrightness[channel] = brightness[channel];
+	}
+
 	ustrncpy(traceView.name, name, VIEW_NAME_SIZE);
 
 	return traceView;
@@ -121,7 +128,7 @@ Activity activity()
 int addView(Activity *activity, void *view, ViewType type)
 {
 	int success = 1; //bad input flag by default
-	if (activity->numPages < LISTVIEW_MAX_ITEMS)
+	if (activity->numPages < ACTIVITY_MAX_PAGES)
 	{
 		activity->menus[activity->numPages] = view;
 		activity->menuTypes[activity->numPages] = type;
@@ -0,0 +1,223 @@
+/**
+ * \file shared_link_stats.c
+ * \brief Common module counting link errors and measuring round trip times between the boards.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_link_stats.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "driverlib/gpio.h"
+#include "driverlib/sysctl.h"
+#include "utils/uartstdio.h"
+
+#define LINK_DEBUG_PERIOD_MS 1000
+
+static volatile unsigned long txDrops = 0;
+static volatile unsigned long poolPeak = 0;
+static volatile unsigned long crcErrors = 0;
+static volatile unsigned long resyncs = 0;
+static volatile unsigned long rxOverruns = 0;
+static volatile unsigned long flashPauses = 0;
+static volatile unsigned long lostEchoes = 0;
+static volatile unsigned long rttHistogram[LINK_RTT_BINS];
+
+static int stampsEnabled = 0;         /**< Whether frames carry sequence numbers and timestamps. */
+static int echoReceived = 0;          /**< Whether lastEchoSequence is valid. */
+static unsigned char lastEchoSequence; /**< Sequence number of the last echo, for counting lost ones. */
+
+void linkStatsTxDrop(void)
+{
+	txDrops++;
+}
+
+void linkStatsPoolUsage(unsigned long inUse)
+{
+	if (inUse > poolPeak)
+	{
+		poolPeak = inUse;
+	}
+}
+
+void linkStatsCrcError(void)
+{
+	crcErrors++;
+}
+
+void linkStatsResync(void)
+{
+	resyncs++;
+}
+
+void linkStatsRxOverrun(void)
+{
+	rxOverruns++;
+}
+
+void linkStatsFlashPause(void)
+{
+	flashPauses++;
+}
+
+void linkStatsEcho(unsigned char sequence, unsigned short timestamp)
+{
+	if (echoReceived)
+	{
+		unsigned char missed = (unsigned char)(sequence - lastEchoSequence - 1);
+		if (missed < 128)
+		{
+			lostEchoes += missed;
+		}
+	}
+	lastEchoSequence = sequence;
+	echoReceived = 1;
+
+	unsigned int bin = (unsigned short)(getLinkTimestamp() - timestamp) / LINK_RTT_BIN_TICKS;
+	if (bin >= LINK_RTT_BINS)
+	{
+		bin = LINK_RTT_BINS - 1;
+	}
+	rttHistogram[bin]++;
+}
+
+unsigned short getLinkTimestamp(void)
+{
+	return (unsigned short)xTaskGetTickCount();
+}
+
+int getLinkStamps(void)
+{
+	return stampsEnabled;
+}
+
+void setLinkStamps(int stamps)
+{
+	stampsEnabled = stamps;
+	echoReceived = 0; // a gap in the sequence is expected after switching
+}
+
+int getLinkTxDrops(void)
+{
+	return txDrops;
+}
+
+int getLinkPoolPeak(void)
+{
+	return poolPeak;
+}
+
+int getLinkCrcErrors(void)
+{
+	return crcErrors;
+}
+
+int getLinkResyncs(void)
+{
+	return resyncs;
+}
+
+int getLinkRxOverruns(void)
+{
+	return rxOverruns;
+}
+
+int getLinkFlashPauses(void)
+{
+	return flashPauses;
+}
+
+int getLinkLostEchoes(void)
+{
+	return lostEchoes;
+}
+
+int getLinkRttCount(unsigned int bin)
+{
+	if (bin >= LINK_RTT_BINS)
+	{
+		return 0;
+	}
+	return rttHistogram[bin];
+}
+
+int getLinkRtt0(void)
+{
+	return getLinkRttCount(0);
+}
+
+int getLinkRtt1(void)
+{
+	return getLinkRttCount(1);
+}
+
+int getLinkRtt2(void)
+{
+	return getLinkRttCount(2);
+}
+
+int getLinkRtt3(void)
+{
+	return getLinkRttCount(3);
+}
+
+int getLinkRtt4(void)
+{
+	return getLinkRttCount(4);
+}
+
+int getLinkRtt5(void)
+{
+	return getLinkRttCount(5);
+}
+
+int getLinkRtt6(void)
+{
+	return getLinkRttCount(6);
+}
+
+void vLinkDebugTask(void *pvParameters)
+{
+	SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOA);
+	GPIOPinTypeUART(GPIO_PORTA_BASE, GPIO_PIN_0 | GPIO_PIN_1);
+	UARTStdioInit(0);
+
+	TickType_t pxPreviousWakeTime = xTaskGetTickCount();
+	const TickType_t xTimeIncrement = configTICK_RATE_HZ * LINK_DEBUG_PERIOD_MS / 1000;
+	unsigned int bin;
+
+	for (;;)
+	{
+		vTaskDelayUntil(&pxPreviousWakeTime, xTimeIncrement);
+
+		UARTprintf("link drops %u peak %u crc %u resync %u overrun %u flash %u lost %u rtt",
+			txDrops, poolPeak, crcErrors, resyncs, rxOverruns, flashPauses, lostEchoes);
+		for (bin = 0; bin < LINK_RTT_BINS; bin++)
+		{
+			UARTprintf(" %u", rttHistogram[bin]);
+		}
+		UARTprintf("\n");
+	}
+}
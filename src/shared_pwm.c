@@ -26,34 +26,148 @@
 
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
+#include "inc/hw_ints.h"
 #include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
 #include "driverlib/pwm.h"
 #include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
 
+#include "FreeRTOS.h"
 #include "shared_pwm.h"
 #include "shared_parameters.h"
 
 //so that we dont go above 3 Volts
 #define MAX_DUTY 1000
 #define FREQ_HZ 100000
+#define SCALE_SHIFT 32  // fractional bits of the precomputed duty scale
+#define DITHER_BITS 8   // fractional pulse width bits carried by the sigma-delta accumulator
+#define DITHER_RATE_HZ 10000  // dither updates a second, every 10th PWM period, well above the RC filter corner
+#define DITHER_TIMER_PERIPH SYSCTL_PERIPH_TIMER3
+#define DITHER_TIMER_BASE TIMER3_BASE
+#define DITHER_TIMER_INT INT_TIMER3A
 
 static long lPeriod;
+static unsigned long pwmGenBits; // generators that have been initialised
+static int ditherTimerReady = 0; // the dither timer has been set up
 
 typedef struct
 {
 	unsigned long pwmOut;
 	unsigned long pwmOutBit;
+	unsigned long pwmGenBit;
 	/*needed as setting the PWM value without initizing the PWM pin will work if the sterllaris previously enabled
 	 * the pwm pin previously even after you supposedly erased sterllaris to get new program on. A power disconnect
 	 * fixes this but even then when setting a PWM pin duty cycle without initizing it causes a small (roughly 0.1Volts)
 	 * PWM noise on the pin.*/
 	int enableFlag;
+	_iq minValue;          // value giving a 0 duty cycle
+	_iq maxValue;          // value giving the desired maximum voltage
+	unsigned long scale;   // pulse width counts per value unit, SCALE_SHIFT fractional bits
+	int ditherFlag;        // pulse width is dithered from isrDitherTimer on Timer3
+	volatile unsigned long ditherTarget; // wanted pulse width, DITHER_BITS fractional bits
+	long ditherAcc;                      // fractional remainder carried between updates, negative while paying back a forced count
 } PwmPin;
 
 
-static PwmPin pwm1 = {PWM_OUT_1, PWM_OUT_1_BIT, 0};
-static PwmPin pwm4 = {PWM_OUT_4, PWM_OUT_4_BIT, 0};
-static PwmPin pwm5 = {PWM_OUT_5, PWM_OUT_5_BIT, 0};
+static PwmPin pwmPins[PWM_NUM_OUTS] =
+{
+	{PWM_OUT_1, PWM_OUT_1_BIT, PWM_GEN_0_BIT, 0, 0, 0, 0, 0, 0, 0},
+	{PWM_OUT_4, PWM_OUT_4_BIT, PWM_GEN_2_BIT, 0, 0, 0, 0, 0, 0, 0},
+	{PWM_OUT_5, PWM_OUT_5_BIT, PWM_GEN_2_BIT, 0, 0, 0, 0, 0, 0, 0}
+};
+
+/**
+ * \brief ISR advancing the dithered outputs at DITHER_RATE_HZ.
+ */
+void isrDitherTimer(void);
+
+/**
+ * \brief Finds the PwmPin matching a PWM output define.
+ *
+ * \param pwmPin The PWM output.
+ * \return Pointer to the PwmPin, NULL if bad input or not enabled.
+ */
+static PwmPin *getPwmPin(char pwmPin)
+{
+	PwmPin *pin;
+	switch (pwmPin)
+	{
+	case 1:
+		pin = &pwmPins[0]; break;
+	case 2:
+		pin = &pwmPins[1]; break;
+	case 4:
+		pin = &pwmPins[2]; break;
+	default:
+		return NULL;
+	}
+
+	return pin->enableFlag ? pin : NULL;
+}
+
+/**
+ * \brief Computes the pulse width for a value, without dividing.
+ *
+ * \param pin The PwmPin to compute for.
+ * \param value The value to output.
+ * \param fracBits Number of fractional bits to keep in the result.
+ * \return The pulse width in PWM clock counts.
+ */
+static unsigned long getPulseWidth(const PwmPin *pin, _iq value, int fracBits)
+{
+	//for the case of bad input that is outside the range
+	if (value > pin->maxValue)
+	{
+		value = pin->maxValue;
+	}
+	if (value < pin->minValue)
+	{
+		value = pin->minValue;
+	}
+
+	return ((unsigned long long)(value - pin->minValue) * pin->scale) >> (SCALE_SHIFT - fracBits);
+}
+
+/**
+ * \brief Sets the pulse width of a pin, or its dither target if it is dithered.
+ *
+ * \param pin The PwmPin to set.
+ * \param value The value to output.
+ * \return The output bit if the output should be on, 0 if it should be off.
+ */
+static unsigned long updatePin(PwmPin *pin, _iq value)
+{
+	if (pin->ditherFlag)
+	{
+		// isrDitherTimer writes the pulse width
+		pin->ditherTarget = getPulseWidth(pin, value, DITHER_BITS);
+		return pin->ditherTarget != 0 ? pin->pwmOutBit : 0;
+	}
+
+	unsigned long pulseWidth = getPulseWidth(pin, value, 0);
+	if (pulseWidth != 0)
+	{
+		PWMPulseWidthSet(PWM_BASE, pin->pwmOut, pulseWidth);
+		return pin->pwmOutBit;
+	}
+	return 0;
+}
+
+/**
+ * \brief Initialises the timer that paces the dither updates, stopped.
+ */
+static void initDitherTimer(void)
+{
+	SysCtlPeripheralEnable(DITHER_TIMER_PERIPH);
+	SysCtlDelay(SysCtlClockGet() / 3000);
+	TimerConfigure(DITHER_TIMER_BASE, TIMER_CFG_PERIODIC);
+	TimerLoadSet(DITHER_TIMER_BASE, TIMER_A, SysCtlClockGet() / DITHER_RATE_HZ);
+	TimerIntRegister(DITHER_TIMER_BASE, TIMER_A, isrDitherTimer);
+	IntPrioritySet(DITHER_TIMER_INT, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	TimerIntEnable(DITHER_TIMER_BASE, TIMER_TIMA_TIMEOUT);
+	ditherTimerReady = 1;
+}
 
 
 /*init the PWM Module*/
@@ -61,94 +175,207 @@ void initPwmModule(char pwmORed)
 {
 	//set the PWM frequency to 100000KHz
 	lPeriod = SysCtlClockGet() / FREQ_HZ;
+	pwmGenBits = 0;
 
 	//set PWM clock to system's clock and enables the PWM perhiferial
 	SysCtlPWMClockSet(SYSCTL_PWMDIV_1);
 	SysCtlPeripheralEnable(SYSCTL_PERIPH_PWM);
 
+	//compare updates are held until PWMSyncUpdate() so that all outputs change on the same period
 	if ((pwmORed % 2) != 0) //Sets up PWM1
 	{
-		PWMGenConfigure(PWM_BASE, PWM_GEN_0, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_NO_SYNC);
+		PWMGenConfigure(PWM_BASE, PWM_GEN_0, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_SYNC);
 		PWMGenPeriodSet(PWM_BASE, PWM_GEN_0, lPeriod);
 		PWMGenEnable(PWM_BASE, PWM_GEN_0);
 		SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOD);
 		GPIOPinTypePWM(GPIO_PORTD_BASE, GPIO_PIN_1);
-		pwm1.enableFlag = 1;
+		pwmPins[0].enableFlag = 1;
+		pwmGenBits |= PWM_GEN_0_BIT;
 	}
 	if (pwmORed !=1) //Sets up PWM4 and/or PWM5 if needed
 	{
-		PWMGenConfigure(PWM_BASE, PWM_GEN_2, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_NO_SYNC);
+		PWMGenConfigure(PWM_BASE, PWM_GEN_2, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_SYNC);
 		PWMGenPeriodSet(PWM_BASE, PWM_GEN_2, lPeriod);
 		PWMGenEnable(PWM_BASE, PWM_GEN_2);
 		SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOF);
+		pwmGenBits |= PWM_GEN_2_BIT;
 		//dont want to not be able to use a pin if we not using it for pwm
 		if (pwmORed == 3 || pwmORed == 2) //Sets up PWM 4 case
 		{
 			GPIOPinTypePWM(GPIO_PORTF_BASE, GPIO_PIN_2);
-			pwm4.enableFlag = 1;
+			pwmPins[1].enableFlag = 1;
 		}
 		else if (pwmORed == 4 || pwmORed == 5) //Sets uo PWM 3 case
 		{
 			GPIOPinTypePWM(GPIO_PORTF_BASE, GPIO_PIN_3);
-			pwm5.enableFlag = 1;
+			pwmPins[2].enableFlag = 1;
 		}
 		else //sets up both PWM4 and PWM5 case
 		{
 			GPIOPinTypePWM(GPIO_PORTF_BASE, GPIO_PIN_2);
 			GPIOPinTypePWM(GPIO_PORTF_BASE, GPIO_PIN_3);
-			pwm4.enableFlag = 1;
-			pwm5.enableFlag = 1;
+			pwmPins[1].enableFlag = 1;
+			pwmPins[2].enableFlag = 1;
 		}
 	}
+
+	//align the generator counters so that synchronised updates land on the same edge
+	PWMSyncTimeBase(PWM_BASE, pwmGenBits);
+
 	//Regardless, default the PWM output on all pins to 0 duty cycle else you get junk from PWM from previous programs
 	PWMOutputState(PWM_BASE, PWM_OUT_1_BIT | PWM_OUT_4_BIT | PWM_OUT_5_BIT, false);
 }
 
 
+void setPwmRange(char pwmPin, _iq minValue, _iq maxValue)
+{
+	PwmPin *pin = getPwmPin(pwmPin);
+	if (pin == NULL || maxValue <= minValue)
+	{
+		return;
+	}
+
+	pin->minValue = minValue;
+	pin->maxValue = maxValue;
+
+	// the only division, (value - minValue) * lPeriod / ((maxValue - minValue) * REAL_MAX_VOLTAGE / DESIRED_MAX_VOLTAGE)
+	pin->scale = (((unsigned long long)lPeriod * DESIRED_MAX_VOLTAGE) << SCALE_SHIFT)
+	             / ((unsigned long long)(maxValue - minValue) * REAL_MAX_VOLTAGE);
+}
+
+
 //set the pwm dutycycle for the PWM of (value - minValue) / (maxValue - minValue) for the PWM pin passed to it
 void setDuty(char pwmPin, _iq value, _iq minValue, _iq maxValue)
 {
-	value >>= 6;
-	minValue >>= 6;
-	maxValue >>= 6;
-	PwmPin pwmToChange;
-	if (pwmPin == 1 && pwm1.enableFlag == 1)
+	PwmPin *pin = getPwmPin(pwmPin);
+	if (pin == NULL)
 	{
-		pwmToChange = pwm1;
+		//bad pwmPin input case
+		return;
 	}
-	else if (pwmPin == 2 && pwm4.enableFlag == 1)
+
+	if (pin->minValue != minValue || pin->maxValue != maxValue)
 	{
-		pwmToChange = pwm4;
+		// range was not set up front, only happens once per range change
+		setPwmRange(pwmPin, minValue, maxValue);
 	}
-	else if (pwmPin == 4 && pwm5.enableFlag == 1)
+
+	if (updatePin(pin, value))
 	{
-		pwmToChange = pwm5;
+		PWMOutputState(PWM_BASE, pin->pwmOutBit, true);
 	}
 	else
 	{
-		//bad pwmPin input case
-		return;
+		PWMOutputState(PWM_BASE, pin->pwmOutBit, false);
 	}
+	PWMSyncUpdate(PWM_BASE, pin->pwmGenBit);
+}
+
 
-	//for the case of bad input that is higher than maxValue
-	if (value > maxValue)
+void setDutyBatch(const _iq values[PWM_NUM_OUTS])
+{
+	unsigned long onBits = 0;
+	unsigned long offBits = 0;
+	unsigned int i;
+
+	for (i = 0; i < PWM_NUM_OUTS; i++)
 	{
-		value = maxValue;
+		PwmPin *pin = &pwmPins[i];
+		if (pin->enableFlag && pin->scale != 0)
+		{
+			if (updatePin(pin, values[i]))
+			{
+				onBits |= pin->pwmOutBit;
+			}
+			else
+			{
+				offBits |= pin->pwmOutBit;
+			}
+		}
 	}
 
+	// latch every generator on the same period boundary
+	PWMSyncUpdate(PWM_BASE, pwmGenBits);
 
-	if (value < minValue)
+	if (onBits)
 	{
-		value = minValue;
+		PWMOutputState(PWM_BASE, onBits, true);
 	}
-	unsigned long pulseWidth = (value - minValue) * lPeriod / ((maxValue - minValue) * REAL_MAX_VOLTAGE / DESIRED_MAX_VOLTAGE);
-	if (pulseWidth != 0)
+	if (offBits)
 	{
-		PWMPulseWidthSet(PWM_BASE, pwmToChange.pwmOut, pulseWidth);
-		PWMOutputState(PWM_BASE, pwmToChange.pwmOutBit, true);
+		PWMOutputState(PWM_BASE, offBits, false);
 	}
-	else
+}
+
+
+void setPwmDither(char pwmPin, int enable)
+{
+	PwmPin *pin = getPwmPin(pwmPin);
+	if (pin == NULL)
+	{
+		return;
+	}
+
+	pin->ditherAcc = 0;
+	pin->ditherFlag = enable;
+
+	// keep the timer running while any pin is dithered
+	unsigned int i;
+	int anyDithered = 0;
+	for (i = 0; i < PWM_NUM_OUTS; i++)
+	{
+		if (pwmPins[i].ditherFlag)
+		{
+			anyDithered = 1;
+		}
+	}
+
+	if (anyDithered)
+	{
+		if (!ditherTimerReady)
+		{
+			initDitherTimer();
+		}
+		TimerEnable(DITHER_TIMER_BASE, TIMER_A);
+	}
+	else if (ditherTimerReady)
 	{
-		PWMOutputState(PWM_BASE, pwmToChange.pwmOutBit, false);
+		TimerDisable(DITHER_TIMER_BASE, TIMER_A);
 	}
 }
+
+
+void isrDitherTimer(void)
+{
+	unsigned long genBits = 0;
+	unsigned int i;
+
+	TimerIntClear(DITHER_TIMER_BASE, TIMER_TIMA_TIMEOUT);
+
+	for (i = 0; i < PWM_NUM_OUTS; i++)
+	{
+		PwmPin *pin = &pwmPins[i];
+		if (pin->ditherFlag && pin->ditherTarget != 0)
+		{
+			// first order sigma-delta, the truncated fraction is carried to the next update
+			pin->ditherAcc += pin->ditherTarget;
+			long pulseWidth = pin->ditherAcc >> DITHER_BITS;
+			if (pulseWidth < 1)
+			{
+				pulseWidth = 1; // a zero width compare glitches, see enableFlag
+			}
+			pin->ditherAcc -= pulseWidth << DITHER_BITS;
+
+			// a target under one count can not be met, only carry one count of debt so it is not paid back forever
+			if (pin->ditherAcc < -(1L << DITHER_BITS))
+			{
+				pin->ditherAcc = -(1L << DITHER_BITS);
+			}
+			PWMPulseWidthSet(PWM_BASE, pin->pwmOut, pulseWidth);
+			genBits |= pin->pwmGenBit;
+		}
+	}
+
+	// takes effect at the start of the next period
+	PWMSyncUpdate(PWM_BASE, genBits);
+}
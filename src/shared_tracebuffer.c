@@ -0,0 +1,354 @@
+/**
+ * \file shared_tracebuffer.c
+ * \brief Compact circular buffer of trace samples, addressed by index rather than pointers
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_tracebuffer.h"
+
+/**
+ * \brief Orders the stores to a sample before the store publishing it.
+ */
+#define MEMORY_BARRIER() __asm volatile ("dmb" ::: "memory")
+
+#define SHORT_MAX 32767
+#define SHORT_MIN (-32768)
+
+/**
+ * \brief Initialises a level with no buckets written.
+ */
+static void levelInit(TraceLevel *level, short *min, short *max, unsigned int channels, unsigned char *dx, unsigned int size,
+		unsigned int shift)
+{
+	level->min = min;
+	level->max = max;
+	level->channels = channels;
+	level->dx = dx;
+	level->size = size;
+	level->shift = shift;
+	level->fill = 0;
+	level->lastWritten = size - 1; // the first bucket written goes in the first place
+	level->used = 0;
+}
+
+/**
+ * \brief Adds a sample to a level, starting new buckets when the sample is past the latest one.
+ *
+ * \param level The level
+ * \param delta Change in x from the previous sample, in x units
+ * \param y The sample, a value for each channel
+ */
+static void levelWrite(TraceLevel *level, unsigned int delta, const short *y)
+{
+	unsigned int buckets;
+	unsigned int channel;
+	short *min;
+	short *max;
+
+	if (level->used == 0)
+	{
+		buckets = 0; // the first bucket starts at the first sample
+	}
+	else if (level->shift == 0)
+	{
+		buckets = delta; // every sample is its own bucket
+	}
+	else
+	{
+		level->fill += delta;
+		buckets = level->fill >> level->shift;
+		level->fill &= (1 << level->shift) - 1;
+
+		if (buckets == 0)
+		{
+			// widen the latest bucket in place
+			min = &level->min[level->lastWritten * level->channels];
+			max = &level->max[level->lastWritten * level->channels];
+			for (channel = 0; channel < level->channels; channel++)
+			{
+				if (y[channel] < min[channel])
+				{
+					min[channel] = y[channel];
+				}
+				if (y[channel] > max[channel])
+				{
+					max[channel] = y[channel];
+				}
+			}
+			return;
+		}
+	}
+
+	unsigned int writing = (level->lastWritten + 1 == level->size) ? 0 : level->lastWritten + 1;
+	min = &level->min[writing * level->channels];
+	max = &level->max[writing * level->channels];
+	for (channel = 0; channel < level->channels; channel++)
+	{
+		min[channel] = y[channel];
+		max[channel] = y[channel]; // the same store at level 0
+	}
+	level->dx[writing] = buckets;
+
+	MEMORY_BARRIER();
+	level->lastWritten = writing; // publish the bucket
+	if (level->used < level->size)
+	{
+		level->used++;
+	}
+}
+
+CompactTraceBuffer createCompactTraceBuffer(short *y, unsigned char *dx, unsigned int size, unsigned int channels, int xUnit)
+{
+	CompactTraceBuffer buffer;
+
+	if (channels > TRACE_MAX_CHANNELS)
+	{
+		channels = TRACE_MAX_CHANNELS;
+	}
+	levelInit(&buffer.levels[0], y, y, channels, dx, size, 0);
+	buffer.numLevels = 1;
+	buffer.xUnit = xUnit > 0 ? xUnit : 1;
+	buffer.lastX = 0;
+	buffer.trigger.state = TRIGGER_IDLE;
+	buffer.writes = 0;
+
+	return buffer;
+}
+
+int compactTraceAddLevel(CompactTraceBuffer *buffer, short *min, short *max, unsigned char *dx, unsigned int size)
+{
+	if (buffer->numLevels >= TRACE_MAX_LEVELS)
+	{
+		return -1;
+	}
+
+	levelInit(&buffer->levels[buffer->numLevels], min, max, buffer->levels[0].channels, dx, size, buffer->numLevels);
+	buffer->numLevels++;
+	return 0;
+}
+
+unsigned int compactTraceLevelFor(const CompactTraceBuffer *buffer, int columnX)
+{
+	unsigned int level = 0;
+	while (level + 1 < buffer->numLevels && (buffer->xUnit << (level + 1)) <= columnX)
+	{
+		level++;
+	}
+	return level;
+}
+
+void compactTraceWrite(CompactTraceBuffer *buffer, int x, const int *y)
+{
+	short row[TRACE_MAX_CHANNELS];
+	unsigned int channel;
+
+	if (buffer->trigger.state == TRIGGER_FROZEN)
+	{
+		return; // hold the capture until armed again
+	}
+
+	buffer->writes++;
+	MEMORY_BARRIER();
+
+	int delta = 0;
+	if (buffer->levels[0].used != 0)
+	{
+		delta = (x - buffer->lastX) / buffer->xUnit;
+		if (delta < 0)
+		{
+			delta = 0;  // traces only move forwards
+		}
+		else if (delta > TRACE_MAX_DELTA)
+		{
+			delta = TRACE_MAX_DELTA;
+		}
+		buffer->lastX += delta * buffer->xUnit;
+	}
+	else
+	{
+		buffer->lastX = x;
+	}
+
+	for (channel = 0; channel < buffer->levels[0].channels; channel++)
+	{
+		if (y[channel] > SHORT_MAX)
+		{
+			row[channel] = SHORT_MAX;
+		}
+		else if (y[channel] < SHORT_MIN)
+		{
+			row[channel] = SHORT_MIN;
+		}
+		else
+		{
+			row[channel] = y[channel];
+		}
+	}
+
+	unsigned int level;
+	for (level = 0; level < buffer->numLevels; level++)
+	{
+		levelWrite(&buffer->levels[level], delta, row);
+	}
+
+	MEMORY_BARRIER();
+	buffer->writes++;
+
+	if (buffer->trigger.state == TRIGGER_ARMED)
+	{
+		if (buffer->trigger.count <= buffer->trigger.pre)
+		{
+			buffer->trigger.count++; // counting up to the trigger sample and those before it
+		}
+	}
+	else if (buffer->trigger.state == TRIGGER_TRIGGERED)
+	{
+		if (--buffer->trigger.count == 0)
+		{
+			buffer->trigger.state = TRIGGER_FROZEN;
+		}
+	}
+}
+
+int compactTraceArm(CompactTraceBuffer *buffer, unsigned int pre, unsigned int post)
+{
+	// keep clear of the oldest sample, readers stop short of it
+	if (pre + post + 2 > buffer->levels[0].size)
+	{
+		return -1;
+	}
+
+	buffer->trigger.state = TRIGGER_IDLE;
+	buffer->trigger.pre = pre;
+	buffer->trigger.post = post;
+	buffer->trigger.count = 0;
+	buffer->trigger.state = TRIGGER_ARMED;
+	return 0;
+}
+
+void compactTraceDisarm(CompactTraceBuffer *buffer)
+{
+	buffer->trigger.state = TRIGGER_IDLE;
+}
+
+int compactTraceTrigger(CompactTraceBuffer *buffer)
+{
+	TraceTrigger *trigger = &buffer->trigger;
+
+	if (trigger->state != TRIGGER_ARMED || trigger->count <= trigger->pre)
+	{
+		return -1;
+	}
+
+	trigger->index = buffer->levels[0].lastWritten;
+	trigger->x = buffer->lastX;
+	trigger->count = trigger->post;
+	MEMORY_BARRIER();
+	trigger->state = trigger->post == 0 ? TRIGGER_FROZEN : TRIGGER_TRIGGERED;
+	return 0;
+}
+
+int compactTraceCaptureRow(const CompactTraceBuffer *buffer, int offset, const short **row, int *dx)
+{
+	const TraceTrigger *trigger = &buffer->trigger;
+	const TraceLevel *samples = &buffer->levels[0];
+
+	if (trigger->state != TRIGGER_FROZEN || offset < -(int)trigger->pre || offset > (int)trigger->post)
+	{
+		return -1;
+	}
+
+	int index = (int)trigger->index + offset;
+	if (index < 0)
+	{
+		index += samples->size;
+	}
+	else if (index >= (int)samples->size)
+	{
+		index -= samples->size;
+	}
+
+	*row = &samples->min[index * samples->channels];
+	*dx = samples->dx[index] * buffer->xUnit;
+	return 0;
+}
+
+int traceCursorLatest(TraceCursor *cursor, const CompactTraceBuffer *buffer, unsigned int level)
+{
+	if (level >= buffer->numLevels || buffer->levels[level].used == 0)
+	{
+		return -1;
+	}
+
+	const TraceLevel *walking = &buffer->levels[level];
+	unsigned int used;
+	unsigned int writes;
+
+	// read where the latest bucket is and its x from the same write
+	do
+	{
+		writes = buffer->writes;
+		MEMORY_BARRIER();
+		used = walking->used;
+		cursor->index = walking->lastWritten;
+		cursor->x = -(int)walking->fill * buffer->xUnit; // the latest bucket starts before the latest sample
+		cursor->latestX = buffer->lastX;
+		MEMORY_BARRIER();
+	}
+	while ((writes & 1) != 0 || writes != buffer->writes);
+
+	cursor->level = walking;
+	cursor->bucketX = buffer->xUnit << walking->shift;
+	// keep clear of the oldest bucket, the writer overwrites it next
+	cursor->remaining = used < walking->size ? used - 1 : used - 2;
+	cursor->min = &walking->min[cursor->index * walking->channels];
+	cursor->max = &walking->max[cursor->index * walking->channels];
+
+	return 0;
+}
+
+int traceCursorPrev(TraceCursor *cursor)
+{
+	const TraceLevel *level = cursor->level;
+
+	if (cursor->remaining == 0)
+	{
+		return -1;
+	}
+
+	// the writer may have come round behind the cursor since it started
+	unsigned int prev = (cursor->index == 0) ? level->size - 1 : cursor->index - 1;
+	unsigned int overwriting = (level->lastWritten + 1 == level->size) ? 0 : level->lastWritten + 1;
+	if (prev == overwriting || prev == level->lastWritten)
+	{
+		return -1;
+	}
+
+	cursor->x -= level->dx[cursor->index] * cursor->bucketX;
+	cursor->index = prev;
+	cursor->min = &level->min[prev * level->channels];
+	cursor->max = &level->max[prev * level->channels];
+	cursor->remaining--;
+
+	return 0;
+}
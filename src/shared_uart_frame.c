@@ -0,0 +1,234 @@
+/**
+ * \file shared_uart_frame.c
+ * \brief Common encoder and decoder of the frames sent between the boards.
+ * \author George Xian
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - George Xian
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "shared_uart_frame.h"
+
+#include <stddef.h>
+
+#include "utils/crc.h"
+
+/**
+ * \brief Looks up a registered type.
+ *
+ * \param registry The registry
+ * \param type Type character of the message
+ * \return The registration, NULL if the type is not registered
+ */
+static const MsgType *findType(const FrameRegistry *registry, unsigned char type)
+{
+	unsigned char position = registry->index[type];
+	return position ? &registry->types[position - 1] : NULL;
+}
+
+int registerFrameType(FrameRegistry *registry, char type, unsigned int length, int binaryOnly, uartCallback handler)
+{
+	if (length == 0 || length > UART_FRAME_SIZE + 1 || (unsigned char)type == UART_SYNC_BYTE)
+	{
+		return -1; // the frame would not fit or be confused with the start of a binary frame
+	}
+
+	unsigned char position = registry->index[(unsigned char)type];
+	if (position == 0)
+	{
+		if (registry->count >= UART_MAX_MSG_TYPES)
+		{
+			return -1;
+		}
+		position = ++registry->count;
+		registry->index[(unsigned char)type] = position;
+	}
+
+	MsgType *msgType = &registry->types[position - 1];
+	msgType->handler = handler;
+	msgType->length = length;
+	msgType->binaryOnly = binaryOnly ? 1 : 0;
+	return 0;
+}
+
+unsigned int getFrameLength(const FrameRegistry *registry, char type)
+{
+	const MsgType *msgType = findType(registry, (unsigned char)type);
+	return msgType ? msgType->length : 0;
+}
+
+void dispatchFrame(const FrameRegistry *registry, UartFrame *uartFrame)
+{
+	const MsgType *msgType = findType(registry, (unsigned char)uartFrame->frameWise.msgType);
+	if (msgType != NULL && msgType->handler != NULL)
+	{
+		msgType->handler(uartFrame);
+	}
+}
+
+unsigned short getFrameCrc(const UartFrame *uartFrame, unsigned int length)
+{
+	return Crc16(0, uartFrame->byteWise, length);
+}
+
+unsigned int encodeFrame(const UartFrame *uartFrame, unsigned int length, int binary, unsigned char *encoded)
+{
+	unsigned int size = 0;
+	unsigned int i;
+
+	if (binary)
+	{
+		encoded[size++] = UART_SYNC_BYTE;
+	}
+	for (i = 0; i < length; i++)
+	{
+		encoded[size++] = uartFrame->byteWise[i];
+	}
+	if (binary)
+	{
+		unsigned short crc = getFrameCrc(uartFrame, length);
+		encoded[size++] = crc & 0xff;
+		encoded[size++] = crc >> 8;
+	}
+
+	return size;
+}
+
+void frameDecoderInit(FrameDecoder *decoder, const FrameRegistry *registry)
+{
+	decoder->registry = registry;
+	decoder->msgLen = 0;
+	decoder->hunting = 0;
+	frameDecoderReset(decoder);
+}
+
+void frameDecoderReset(FrameDecoder *decoder)
+{
+	decoder->state = DECODE_IDLE;
+	decoder->index = 0;
+}
+
+/**
+ * \brief Marks the decoder as hunting for the next frame.
+ *
+ * \param decoder The decoder
+ * \return DECODE_RESYNC the first time boundaries are lost, DECODE_NONE while still hunting
+ */
+static DecodeResult startHunting(FrameDecoder *decoder)
+{
+	if (decoder->hunting)
+	{
+		return DECODE_NONE;
+	}
+
+	decoder->hunting = 1;
+	return DECODE_RESYNC;
+}
+
+DecodeResult decodeFrameByte(FrameDecoder *decoder, unsigned char receivedChar)
+{
+	DecodeResult result = DECODE_NONE;
+
+	switch (decoder->state)
+	{
+	case DECODE_IDLE:
+		if (decoder->index == 0)
+		{
+			if (receivedChar == UART_SYNC_BYTE)
+			{
+				// start of a binary frame
+				decoder->state = DECODE_TYPE;
+				break;
+			}
+
+			// decode message type, types only sent with a CRC are never taken as the start of an ASCII frame
+			const MsgType *msgType = findType(decoder->registry, receivedChar);
+			decoder->msgLen = msgType ? msgType->length : 0;
+			if (decoder->msgLen && !msgType->binaryOnly)
+			{
+				// only valid message types get to advance (msgLen = 0 is invalid)
+				decoder->frame.frameWise.msgType = receivedChar;
+				decoder->index++;
+			}
+			else
+			{
+				result = startHunting(decoder);
+			}
+		}
+		else
+		{
+			// adding more characters onto frame
+			decoder->frame.byteWise[decoder->index] = receivedChar;
+			decoder->index++;
+		}
+
+		if (decoder->index != 0 && decoder->index >= decoder->msgLen)
+		{
+			// end of message given message type, complete without waiting for the next frame
+			decoder->index = 0;
+			decoder->hunting = 0;
+			result = DECODE_FRAME;
+		}
+		break;
+	case DECODE_TYPE:
+		decoder->msgLen = getFrameLength(decoder->registry, receivedChar);
+		if (decoder->msgLen)
+		{
+			decoder->frame.frameWise.msgType = receivedChar;
+			decoder->index = 1;
+			decoder->state = (decoder->index >= decoder->msgLen) ? DECODE_CRC : DECODE_PAYLOAD;
+		}
+		else
+		{
+			// not a frame after all, resynchronise on the next sync byte or type
+			decoder->state = DECODE_IDLE;
+			result = startHunting(decoder);
+		}
+		break;
+	case DECODE_PAYLOAD:
+		decoder->frame.byteWise[decoder->index] = receivedChar;
+		decoder->index++;
+		if (decoder->index >= decoder->msgLen)
+		{
+			decoder->state = DECODE_CRC;
+		}
+		break;
+	case DECODE_CRC:
+		decoder->crcLow = receivedChar;
+		decoder->state = DECODE_CRC_HIGH;
+		break;
+	case DECODE_CRC_HIGH:
+		// corrupted frames are dropped rather than passed on
+		if (getFrameCrc(&decoder->frame, decoder->msgLen) != (decoder->crcLow | (receivedChar << 8)))
+		{
+			result = DECODE_CRC_ERROR;
+		}
+		else
+		{
+			decoder->hunting = 0;
+			result = DECODE_FRAME;
+		}
+		decoder->index = 0;
+		decoder->state = DECODE_IDLE;
+		break;
+	}
+
+	return result;
+}
@@ -25,38 +25,420 @@
  */
 
 #include "shared_uart_task.h"
+#include "shared_link_stats.h"
 
 #include "FreeRTOS.h"
-#include "queue.h"
+#include "semphr.h"
 #include "task.h"
 #include "inc/hw_types.h"
 #include "inc/hw_memmap.h"
+#include "inc/hw_ints.h"
 #include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
 #include "driverlib/sysctl.h"
 #include "driverlib/uart.h"
+#include "utils/ringbuf.h"
 
-#ifndef NULL
-#define NULL ((void *)0)
-#endif
+#define UART_RX_BUFFER_SIZE 64
+#define UART_TX_POOL_SIZE 16
 
-#define SENDMESSAGE_QUEUE_SIZE 10
-#define UART_TASK_RATE_HZ 1000
-#define UART_PERCHAR_HZ 75000   // 13.3us delay between characters
-#define UART_BAUD 625000
+#define MS_TO_TICKS(ms) ((TickType_t)((ms) * configTICK_RATE_HZ / 1000))
+#define NEGOTIATE_START_MS 2000     /**< How long the master keeps asking before assuming the peer does not negotiate. */
+#define NEGOTIATE_WAIT_MS 3000      /**< How long the slave waits for the first request. */
+#define NEGOTIATE_RETRY_MS 20       /**< Time between requests from the master. */
+#define NEGOTIATE_SETTLE_MS 2       /**< Time for the slave to switch rate after acknowledging. */
+#define NEGOTIATE_LOOPBACK_MS 20    /**< Time allowed for the test pattern to be echoed. */
+#define NEGOTIATE_COMMIT_MS 50      /**< Time the slave waits for the commit after echoing. */
+#define NEGOTIATE_FALLBACK_MS 100   /**< Time for the slave to give up on a failed rate and return to the base rate. */
+#define NEGOTIATE_COMMIT_REPEATS 3
+#define LINK_LOST_MS 500            /**< Time without a good frame after which the link is renegotiated, several ASC keepalives. */
+#define LINK_LOST_ERRORS 16         /**< Decode errors in a row after which the link is renegotiated. */
 
-static uartCallback receivedCallback;
-static QueueHandle_t uartSendQueue;
+/**
+ * \brief A frame buffer in the transmit pool, filled in place by the producer and sent from by the ISR
+ */
+typedef struct
+{
+	UartFrame frame;       /**< Must be first, claimed frames are converted back to slots by address */
+	unsigned char length;  /**< Bytes of frame to send, set on commit */
+	unsigned char binary;  /**< Whether to wrap the frame with a sync byte and CRC */
+	unsigned short crc;    /**< CRC of the frame for binary frames */
+} TxSlot;
+
+static FrameRegistry registry;        /**< Registered message types. */
+static FrameDecoder decoder;
+static SemaphoreHandle_t rxSemaphore;  /**< Given by the ISR when bytes have been received. */
+
+static tRingBufObject rxRing;
+static unsigned char rxBuffer[UART_RX_BUFFER_SIZE];
+
+static int uartMaster = 0;                 /**< Whether this board leads the baud rate negotiation. */
+static unsigned long uartBaud = UART_BAUD; /**< The negotiated baud rate. */
+static volatile int linkReady = 0;         /**< Set once negotiation is over and frames can be claimed. */
+static volatile int txHold = 1;            /**< Keeps the ISR from sending pool frames while negotiating. */
+static volatile int txPaused = 0;          /**< Keeps the ISR from sending pool frames while flash is written. */
+static volatile char negotiateType;        /**< Type of the last negotiation frame received, 0 if consumed. */
+static TickType_t lastGoodFrame;           /**< Tick count when the last frame was decoded. */
+static unsigned int errorRun;              /**< Decode errors since the last frame was decoded. */
+static volatile int negotiateCandidate;    /**< Candidate rate index of the last negotiation frame. */
+static const unsigned long baudCandidates[UART_BAUD_CANDIDATES] = UART_BAUD_CANDIDATE_LIST;
+
+static TxSlot txPool[UART_TX_POOL_SIZE];
+static tRingBufObject freeSlots;   /**< Indices of unclaimed slots. */
+static tRingBufObject readySlots;  /**< Indices of committed slots in send order. */
+static unsigned char freeSlotsBuffer[UART_TX_POOL_SIZE + 1];
+static unsigned char readySlotsBuffer[UART_TX_POOL_SIZE + 1];
+static volatile int txSlot = -1;   /**< Slot being transmitted by the ISR, -1 if idle. */
+static unsigned int txPosition;    /**< Next byte of the slot to transmit, 0 being the sync byte. */
+
+/**
+ * \brief Commits a claimed frame for sending.
+ *
+ * \param uartFrame Frame returned by claimMsgToSend()
+ * \param binary Whether to send the frame with a sync byte and CRC
+ * \return 0 for success, -1 if the type is not registered, the slot is then freed
+ */
+static int commitFrame(UartFrame *uartFrame, int binary);
+
+/**
+ * \brief Feeds one received byte through the frame decoder, dispatching completed frames.
+ *
+ * \param receivedChar The byte received
+ */
+static void decodeByte(unsigned char receivedChar);
+
+/**
+ * \brief ISR moving bytes between the UART FIFOs and the ring buffers.
+ */
+void isrUart1(void);
+
+/**
+ * \brief Moves bytes from the committed slots into the UART FIFO until it is full.
+ *
+ * Must be called from the ISR or with the UART interrupt masked.
+ */
+static void fillTxFifo(void)
+{
+	while (!txHold && !txPaused && UARTSpaceAvail(UART1_BASE))
+	{
+		if (txSlot < 0)
+		{
+			if (RingBufEmpty(&readySlots))
+			{
+				return;
+			}
+			txSlot = RingBufReadOne(&readySlots);
+			txPosition = txPool[txSlot].binary ? 0 : 1; // ASCII frames have no sync byte
+		}
+
+		TxSlot *slot = &txPool[txSlot];
+		unsigned char txByte;
+		if (txPosition == 0)
+		{
+			txByte = UART_SYNC_BYTE;
+		}
+		else if (txPosition <= slot->length)
+		{
+			txByte = slot->frame.byteWise[txPosition - 1];
+		}
+		else
+		{
+			txByte = (txPosition == slot->length + 1) ? (slot->crc & 0xff) : (slot->crc >> 8);
+		}
+		UARTCharPutNonBlocking(UART1_BASE, txByte);
+		txPosition++;
+
+		if (txPosition > slot->length + (slot->binary ? UART_CRC_BYTES : 0))
+		{
+			// slot fully sent, hand it back to the producers
+			RingBufWriteOne(&freeSlots, txSlot);
+			txSlot = -1;
+		}
+	}
+}
+
+/**
+ * \brief Handles the baud rate negotiation frames.
+ *
+ * \param uartFrame The received frame
+ */
+static void readNegotiateMessage(UartFrame *uartFrame)
+{
+	negotiateCandidate = (unsigned char)uartFrame->frameWise.msg[0];
+	negotiateType = uartFrame->frameWise.msgType;
+}
+
+/**
+ * \brief Switches the link rate once anything being sent has gone, discarding anything half received.
+ *
+ * \param baud The new rate
+ */
+static void setBaud(unsigned long baud)
+{
+	while (UARTBusy(UART1_BASE))
+	{
+		vTaskDelay(1);
+	}
+	UARTDisable(UART1_BASE);
+	UARTConfigSetExpClk(UART1_BASE, SysCtlClockGet(), baud, UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE);
+	UARTEnable(UART1_BASE);
+
+	taskENTER_CRITICAL();
+	RingBufFlush(&rxRing);
+	taskEXIT_CRITICAL();
+	frameDecoderReset(&decoder);
+	uartBaud = baud;
+}
+
+/**
+ * \brief Sends a negotiation frame directly, bypassing the transmit pool.
+ *
+ * \param type The negotiation frame type
+ * \param candidate Index of the candidate rate
+ */
+static void sendNegotiateFrame(char type, unsigned char candidate)
+{
+	UartFrame frame;
+	unsigned char encoded[UART_MAX_ENCODED];
+	unsigned int length;
+	unsigned int i;
+
+	frame.frameWise.msgType = type;
+	frame.frameWise.msg[0] = candidate;
+	length = encodeFrame(&frame, NEGOTIATE_MSG_LEN, 1, encoded);
+	for (i = 0; i < length; i++)
+	{
+		UARTCharPut(UART1_BASE, encoded[i]);
+	}
+}
+
+/**
+ * \brief Decodes received bytes until a negotiation frame of the given type arrives.
+ *
+ * \param type The negotiation frame type to wait for
+ * \param timeout Ticks to wait
+ * \return The candidate index in the frame, -1 on timeout
+ */
+static int waitNegotiateFrame(char type, TickType_t timeout)
+{
+	TickType_t start = xTaskGetTickCount();
+
+	negotiateType = 0;
+	for (;;)
+	{
+		while (!RingBufEmpty(&rxRing))
+		{
+			decodeByte(RingBufReadOne(&rxRing));
+			if (negotiateType == type)
+			{
+				return negotiateCandidate;
+			}
+		}
+
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= timeout)
+		{
+			return -1;
+		}
+		xSemaphoreTake(rxSemaphore, timeout - elapsed);
+	}
+}
+
+/**
+ * \brief Waits for the next raw received byte.
+ *
+ * \param deadline Tick count to give up at
+ * \return The byte, -1 on timeout
+ */
+static int waitRawByte(TickType_t deadline)
+{
+	while (RingBufEmpty(&rxRing))
+	{
+		TickType_t now = xTaskGetTickCount();
+		if ((long)(deadline - now) <= 0)
+		{
+			return -1;
+		}
+		xSemaphoreTake(rxSemaphore, deadline - now);
+	}
+	return RingBufReadOne(&rxRing);
+}
 
 /**
- * \brief Determines the total length of the message including type character
+ * \brief Sends the test pattern and counts the bit errors in what the slave echoes back.
  *
- * \param type Char representing message type (W, R, S, A, M)
- * \return Length of frame including the type character, 0 if did not correspond to a type
+ * \return Number of bit errors, missing bytes counting as 8
  */
-unsigned int getMsgLen(char type);
+static unsigned int loopbackBitErrors(void)
+{
+	unsigned int errors = 0;
+	unsigned int i;
+
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		UARTCharPut(UART1_BASE, NEGOTIATE_PATTERN(i));
+	}
+
+	TickType_t deadline = xTaskGetTickCount() + MS_TO_TICKS(NEGOTIATE_LOOPBACK_MS);
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		int echoed = waitRawByte(deadline);
+		if (echoed < 0)
+		{
+			return errors + 8 * (NEGOTIATE_LOOPBACK_BYTES - i);
+		}
+
+		unsigned char difference = (unsigned char)echoed ^ NEGOTIATE_PATTERN(i);
+		for (; difference; difference &= difference - 1)
+		{
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/**
+ * \brief Echoes the test pattern back to the master.
+ *
+ * \return 0 if the whole pattern was echoed, -1 on timeout
+ */
+static int echoLoopback(void)
+{
+	TickType_t deadline = xTaskGetTickCount() + MS_TO_TICKS(NEGOTIATE_LOOPBACK_MS);
+	unsigned int i;
+
+	for (i = 0; i < NEGOTIATE_LOOPBACK_BYTES; i++)
+	{
+		int received = waitRawByte(deadline);
+		if (received < 0)
+		{
+			return -1;
+		}
+		UARTCharPut(UART1_BASE, received);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Leads the negotiation, trying each candidate rate from the fastest until one passes the loopback test.
+ */
+static void negotiateMaster(void)
+{
+	TickType_t start = xTaskGetTickCount();
+	unsigned char candidate;
+
+	for (candidate = 0; candidate < UART_BAUD_CANDIDATES; candidate++)
+	{
+		int acknowledged;
+		do
+		{
+			sendNegotiateFrame(NEGOTIATE_REQUEST_MSG, candidate);
+			acknowledged = waitNegotiateFrame(NEGOTIATE_ACK_MSG, MS_TO_TICKS(NEGOTIATE_RETRY_MS));
+		}
+		while (acknowledged != candidate && xTaskGetTickCount() - start < MS_TO_TICKS(NEGOTIATE_START_MS));
+
+		if (acknowledged != candidate)
+		{
+			return; // the peer does not negotiate, stay at the base rate
+		}
+
+		setBaud(baudCandidates[candidate]);
+		vTaskDelay(MS_TO_TICKS(NEGOTIATE_SETTLE_MS));
+
+		if (loopbackBitErrors() == 0)
+		{
+			unsigned int repeat;
+			for (repeat = 0; repeat < NEGOTIATE_COMMIT_REPEATS; repeat++)
+			{
+				sendNegotiateFrame(NEGOTIATE_COMMIT_MSG, candidate);
+			}
+			return;
+		}
+
+		// let the slave time out back to the base rate before trying the next candidate
+		setBaud(UART_BAUD);
+		vTaskDelay(MS_TO_TICKS(NEGOTIATE_FALLBACK_MS));
+		start = xTaskGetTickCount();
+	}
+}
+
+/**
+ * \brief Follows the negotiation, echoing the test pattern at each rate the master asks for.
+ *
+ * \param timeout Ticks to wait for the master's first request
+ */
+static void negotiateSlave(TickType_t timeout)
+{
+	for (;;)
+	{
+		int candidate = waitNegotiateFrame(NEGOTIATE_REQUEST_MSG, timeout);
+		if (candidate < 0 || candidate >= UART_BAUD_CANDIDATES)
+		{
+			return; // no master, stay at the base rate
+		}
+
+		sendNegotiateFrame(NEGOTIATE_ACK_MSG, candidate);
+		setBaud(baudCandidates[candidate]);
+
+		if (echoLoopback() == 0 && waitNegotiateFrame(NEGOTIATE_COMMIT_MSG, MS_TO_TICKS(NEGOTIATE_COMMIT_MS)) == candidate)
+		{
+			return;
+		}
+
+		// the master drops back too and tries the next candidate
+		setBaud(UART_BAUD);
+		timeout = MS_TO_TICKS(NEGOTIATE_START_MS);
+	}
+}
+
+/**
+ * \brief Drops back to the base rate and negotiates again, after the link was lost or the master asked to.
+ *
+ * Either board may have reset, or the commit of the last negotiation been lost, leaving the ends at
+ * different rates. The master asks again at the base rate, the slave waits there for it to.
+ */
+static void relink(void)
+{
+	linkReady = 0;
+	txHold = 1;
+	setBaud(UART_BAUD);
+	if (uartMaster)
+	{
+		negotiateMaster();
+	}
+	else
+	{
+		negotiateSlave(MS_TO_TICKS(NEGOTIATE_WAIT_MS));
+	}
+
+	lastGoodFrame = xTaskGetTickCount();
+	errorRun = 0;
+	negotiateType = 0;
+	linkReady = 1;
+	txHold = 0;
+
+	// frames committed before the link was lost are still queued, start them off
+	taskENTER_CRITICAL();
+	fillTxFifo();
+	taskEXIT_CRITICAL();
+}
 
 void vUartTask(void *pvParameters)
 {
+	// initialize buffers before the interrupt can use them
+	RingBufInit(&rxRing, rxBuffer, UART_RX_BUFFER_SIZE);
+	frameDecoderInit(&decoder, &registry);
+	RingBufInit(&freeSlots, freeSlotsBuffer, UART_TX_POOL_SIZE + 1);
+	RingBufInit(&readySlots, readySlotsBuffer, UART_TX_POOL_SIZE + 1);
+	unsigned char slotIndex;
+	for (slotIndex = 0; slotIndex < UART_TX_POOL_SIZE; slotIndex++)
+	{
+		RingBufWriteOne(&freeSlots, slotIndex);
+	}
+	rxSemaphore = xSemaphoreCreateBinary();
+
 	// setup Uart peripheral
 	SysCtlPeripheralEnable(SYSCTL_PERIPH_UART1);
 	SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOD);
@@ -64,122 +446,222 @@ void vUartTask(void *pvParameters)
 	GPIOPinTypeUART(GPIO_PORTD_BASE, GPIO_PIN_3 | GPIO_PIN_2);
 
 	UARTConfigSetExpClk(UART1_BASE, SysCtlClockGet(), UART_BAUD, UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE);
-	UARTEnable(UART1_BASE);
-
-	// initialize queue
-	uartSendQueue = xQueueCreate(SENDMESSAGE_QUEUE_SIZE, sizeof(UartFrame));
 
-	// initialize FreeRTOS sleep parameters
-	TickType_t xLastWakeTime;
-	const TickType_t xTimeIncrement = configTICK_RATE_HZ / UART_TASK_RATE_HZ;
-	xLastWakeTime = xTaskGetTickCount();
+	// interrupt when the transmit FIFO is nearly empty, or on receive with a timeout for partial FIFOs
+	UARTFIFOLevelSet(UART1_BASE, UART_FIFO_TX1_8, UART_FIFO_RX4_8);
+	UARTIntRegister(UART1_BASE, isrUart1);
+	IntPrioritySet(INT_UART1, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	UARTIntEnable(UART1_BASE, UART_INT_RX | UART_INT_RT | UART_INT_TX);
+	UARTEnable(UART1_BASE);
 
-	// message decoding variables
-	UartFrame buffer;
-	unsigned int msgLen;
-	unsigned int index = 0;
-	char lastChar;
+	// find the fastest rate both boards can sustain before any other frames are sent
+	registerMsgType(NEGOTIATE_REQUEST_MSG, NEGOTIATE_MSG_LEN, 1, readNegotiateMessage);
+	registerMsgType(NEGOTIATE_ACK_MSG, NEGOTIATE_MSG_LEN, 1, readNegotiateMessage);
+	registerMsgType(NEGOTIATE_COMMIT_MSG, NEGOTIATE_MSG_LEN, 1, readNegotiateMessage);
+	if (uartMaster)
+	{
+		negotiateMaster();
+	}
+	else
+	{
+		negotiateSlave(MS_TO_TICKS(NEGOTIATE_WAIT_MS));
+	}
+	lastGoodFrame = xTaskGetTickCount();
+	negotiateType = 0;
+	linkReady = 1;
+	txHold = 0;
 
 	for (;;)
 	{
-		vTaskDelayUntil(&xLastWakeTime, xTimeIncrement);
+		// sleep until the ISR has received something, waking to notice silence
+		xSemaphoreTake(rxSemaphore, MS_TO_TICKS(LINK_LOST_MS));
 
-		// process message send queue
-		UartFrame toSend;
-		while (xQueueReceive(uartSendQueue, &toSend, 0) == pdTRUE)
+		// receive and decode messages
+		while (!RingBufEmpty(&rxRing))
 		{
-			unsigned int msgLen = getMsgLen(toSend.frameWise.msgType);
-
-			unsigned int i = 0;
-			for (i = 0; i<msgLen; i++)
-			{
-				while (!UARTCharPutNonBlocking(UART1_BASE, (unsigned char)toSend.byteWise[i]))
-				{
-					vTaskDelay(1);
-				}
-			}
-			vTaskDelay(msgLen * configTICK_RATE_HZ / UART_PERCHAR_HZ); // put delay between messages
+			decodeByte(RingBufReadOne(&rxRing));
 		}
 
-		long receivedChar;
-		// receive and decode messages
-		while ((receivedChar = UARTCharGetNonBlocking(UART1_BASE)) > -1)
+		// the master renegotiating means it lost the link, follow it to the base rate
+		if (!uartMaster && negotiateType == NEGOTIATE_REQUEST_MSG)
 		{
+			relink();
+		}
+		else if (xTaskGetTickCount() - lastGoodFrame >= MS_TO_TICKS(LINK_LOST_MS) || errorRun >= LINK_LOST_ERRORS)
+		{
+			relink();
+		}
+	}
+}
 
-			if (index == 0)
+static void decodeByte(unsigned char receivedChar)
+{
+	switch (decodeFrameByte(&decoder, receivedChar))
+	{
+	case DECODE_FRAME:
+		lastGoodFrame = xTaskGetTickCount();
+		errorRun = 0;
+		dispatchFrame(&registry, &decoder.frame);
+		break;
+	case DECODE_CRC_ERROR:
+		errorRun++;
+		linkStatsCrcError();
+		break;
+	case DECODE_RESYNC:
+		errorRun++;
+		linkStatsResync();
+		break;
+	case DECODE_NONE:
+		break;
+	}
+}
+
+void isrUart1(void)
+{
+	portBASE_TYPE higherPriorityTaskWoken = pdFALSE;
+	unsigned long status = UARTIntStatus(UART1_BASE, true);
+	UARTIntClear(UART1_BASE, status);
+
+	if (status & (UART_INT_RX | UART_INT_RT))
+	{
+		while (UARTCharsAvail(UART1_BASE))
+		{
+			unsigned char receivedChar = (unsigned char)UARTCharGetNonBlocking(UART1_BASE);
+			if (!RingBufFull(&rxRing))
 			{
-				// decode message type
-				msgLen = getMsgLen((char)receivedChar);
-				if (msgLen && lastChar != 'M' && lastChar != 'W')
-				{
-					// only valid message types get to advance (msgLen = 0 is invalid)
-					buffer.frameWise.msgType = (char)receivedChar;
-					index++;
-				}
+				RingBufWriteOne(&rxRing, receivedChar);
 			}
 			else
 			{
-				if (index >= msgLen && receivedCallback != NULL)
-				{
-					// end of message given message type
-					receivedCallback(&buffer);
-					index = 0;
-				}
-				else
-				{
-					// adding more characters onto frame
-					buffer.byteWise[index] = (char)receivedChar;
-					index++;
-				}
+				linkStatsRxOverrun();
 			}
-
-			lastChar = (char)receivedChar; // store the last character
 		}
+		xSemaphoreGiveFromISR(rxSemaphore, &higherPriorityTaskWoken);
 	}
+
+	if (status & UART_INT_TX)
+	{
+		fillTxFifo();
+	}
+
+	portEND_SWITCHING_ISR(higherPriorityTaskWoken);
 }
 
-void attachOnReceiveCallback(void (*callback)(UartFrame *))
+void setUartMaster(int master)
 {
-	receivedCallback = callback;
+	uartMaster = master;
 }
 
-int queueMsgToSend(UartFrame *uartFrame)
+int getUartKbaud(void)
+{
+	return uartBaud / 1000;
+}
+
+void setUartPaused(int paused)
 {
-	if (uartSendQueue == 0)
+	taskENTER_CRITICAL();
+	txPaused = paused;
+	fillTxFifo();
+	taskEXIT_CRITICAL();
+}
+
+int registerMsgType(char type, unsigned int length, int binaryOnly, uartCallback handler)
+{
+	return registerFrameType(&registry, type, length, binaryOnly, handler);
+}
+
+UartFrame *claimMsgToSend(void)
+{
+	if (!linkReady)
+	{
+		return NULL; // uart has not been initialised or is negotiating
+	}
+
+	int slotIndex = -1;
+	unsigned long inUse;
+
+	taskENTER_CRITICAL();
+	if (!RingBufEmpty(&freeSlots))
 	{
-		return -2; // queue has not been created
+		slotIndex = RingBufReadOne(&freeSlots);
 	}
+	inUse = UART_TX_POOL_SIZE - RingBufUsed(&freeSlots);
+	taskEXIT_CRITICAL();
 
-	if (xQueueSendToBack(uartSendQueue, (void *)uartFrame, 0) == pdTRUE)
+	if (slotIndex < 0)
 	{
-		return 0;
+		linkStatsTxDrop();
+		return NULL;
 	}
-	else
+
+	linkStatsPoolUsage(inUse);
+	return &txPool[slotIndex].frame;
+}
+
+int commitMsgToSend(UartFrame *uartFrame)
+{
+	return commitFrame(uartFrame, 0);
+}
+
+int commitBinaryMsgToSend(UartFrame *uartFrame)
+{
+	return commitFrame(uartFrame, 1);
+}
+
+static int commitFrame(UartFrame *uartFrame, int binary)
+{
+	TxSlot *slot = (TxSlot *)uartFrame;
+
+	slot->length = getFrameLength(&registry, uartFrame->frameWise.msgType);
+	if (slot->length == 0)
 	{
-		return -1; // queue full
+		// an unregistered type would stall the transmitter, so give the slot back
+		taskENTER_CRITICAL();
+		RingBufWriteOne(&freeSlots, slot - txPool);
+		taskEXIT_CRITICAL();
+		return -1;
 	}
+	slot->binary = binary;
+	if (binary)
+	{
+		slot->crc = getFrameCrc(uartFrame, slot->length);
+	}
+
+	taskENTER_CRITICAL();
+	RingBufWriteOne(&readySlots, slot - txPool);
+
+	// the transmit interrupt only fires on the FIFO draining, so start it off
+	fillTxFifo();
+	taskEXIT_CRITICAL();
+
+	return 0;
 }
 
-int getSendQueueAvailSpaces(void)
+int queueMsgToSend(UartFrame *uartFrame)
 {
-	return uxQueueMessagesWaiting(uartSendQueue);
+	UartFrame *claimed = claimMsgToSend();
+	if (claimed == NULL)
+	{
+		return linkReady ? -1 : -2;
+	}
+
+	*claimed = *uartFrame;
+	return commitMsgToSend(claimed);
 }
 
-unsigned int getMsgLen(char type)
+int queueBinaryMsgToSend(UartFrame *uartFrame)
 {
-	switch (type)
+	UartFrame *claimed = claimMsgToSend();
+	if (claimed == NULL)
 	{
-	case ('W'):
-		return 2;
-	case ('R'):
-		return 3;
-	case ('S'):
-		return 1;
-	case ('A'):
-		return 7;
-	case ('M'):
-		return 2;
-	default:
-		return 0;
+		return linkReady ? -1 : -2;
 	}
+
+	*claimed = *uartFrame;
+	return commitBinaryMsgToSend(claimed);
+}
+
+int getSendQueueAvailSpaces(void)
+{
+	return RingBufUsed(&freeSlots);
 }
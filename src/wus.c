@@ -40,17 +40,47 @@
 #include "shared_guidraw_task.h"
 #include "shared_uart_task.h"
 #include "shared_button_task.h"
-#include "shared_tracenode.h"
-
-#define NUM_ROAD_NODES 200
+#include "shared_tracebuffer.h"
+#include "shared_calibration.h"
+
+#define NUM_ROAD_SAMPLES 1000
+#define ROAD_X_UNIT 100          /**< Distance travelled each simulation step */
+#define ROAD_LEVELS 3            /**< Summary levels for zooming out to 8 steps a pixel column */
+#define ROAD_LEVEL_BUCKETS 132   /**< A few over twice the plot columns, enough to fill the plot at any zoom */
+#define NUM_DYNAMICS_SAMPLES 256 /**< Enough to fill the plot at two samples a pixel */
+#define DYNAMICS_VERT_SCALE 25   /**< Full scale of each channel reaches the top and bottom of the plot */
+#define NUM_CAPTURE_SAMPLES 384  /**< Steps of the dynamics kept around a trigger, enough for the plot zoomed out to 3 */
+#define CAPTURE_PRE_TRIGGER 127  /**< Steps captured before the trigger */
+#define CAPTURE_POST_TRIGGER 255 /**< Steps captured after the trigger */
 
 static const char *placeholder = "test";
 
 static Activity mainActivity;
 
 static TraceView roadSurface;
-static TraceNode roadNodes[NUM_ROAD_NODES];
-static CircularBufferHandler roadHandler;
+static short roadY[NUM_ROAD_SAMPLES];
+static unsigned char roadDx[NUM_ROAD_SAMPLES];
+static CompactTraceBuffer roadHandler;
+static short roadMin[ROAD_LEVELS][ROAD_LEVEL_BUCKETS];
+static short roadMax[ROAD_LEVELS][ROAD_LEVEL_BUCKETS];
+static unsigned char roadLevelDx[ROAD_LEVELS][ROAD_LEVEL_BUCKETS];
+
+static TraceView dynamicsTrace;
+static short dynamicsY[NUM_DYNAMICS_SAMPLES * DYNAMICS_CHANNELS];
+static unsigned char dynamicsDx[NUM_DYNAMICS_SAMPLES];
+static CompactTraceBuffer dynamicsHandler;
+
+static TraceView captureTrace;
+static short captureY[NUM_CAPTURE_SAMPLES * DYNAMICS_CHANNELS];
+static unsigned char captureDx[NUM_CAPTURE_SAMPLES];
+static CompactTraceBuffer captureHandler;
+static ListView capture;
+static Options captureTriggerOption;
+static Item captureTriggerItem;
+static Options captureStateOption;
+static Item captureStateItem;
+static Options captureDumpOption;
+static Item captureDumpItem;
 
 static ListView telemetry;
 static Options speedOption;
@@ -69,6 +99,12 @@ static Options roadTypeOption;
 static Item roadTypeItem;
 static Options throttleOption;
 static Item throttleItem;
+static Options calibrateOption;
+static Item calibrateItem;
+static Item baudItem;
+static Options baudOption;
+static Item displayBytesItem;
+static Options displayBytesOption;
 
 static ListView wusStatusEcho;
 static Item wusStatusCoilItem;
@@ -94,9 +130,46 @@ int main(void)
 	SysCtlClockSet(SYSCTL_SYSDIV_4 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN | SYSCTL_XTAL_8MHZ);
 
 	/* Marking up GUI */
-	roadHandler = createCircularBuffer(roadNodes, NUM_ROAD_NODES, BUFFERFULLMODE_OVERWRITE);
+	roadHandler = createCompactTraceBuffer(roadY, roadDx, NUM_ROAD_SAMPLES, 1, ROAD_X_UNIT);
+	unsigned int level;
+	for (level = 0; level < ROAD_LEVELS; level++)
+	{
+		compactTraceAddLevel(&roadHandler, roadMin[level], roadMax[level], roadLevelDx[level], ROAD_LEVEL_BUCKETS);
+	}
 	setRoadBuffer(&roadHandler); // pass it to the sim task
-	roadSurface = traceView("Surface", &roadHandler, TRACE_ZERO_DYNAMIC, 30, 30, 8);
+	roadSurface = traceView("Surface", &roadHandler, TRACE_ZERO_DYNAMIC, 30, 480, 8);
+
+	/* sprung acceleration, coil extension and force overlaid as percentages of full scale */
+	dynamicsHandler = createCompactTraceBuffer(dynamicsY, dynamicsDx, NUM_DYNAMICS_SAMPLES, DYNAMICS_CHANNELS, 1);
+	setDynamicsBuffer(&dynamicsHandler);
+	dynamicsTrace = traceView("Dynamics", &dynamicsHandler, TRACE_ZERO_CENTER, 1, 1, DYNAMICS_VERT_SCALE);
+
+	/* the dynamics every step around the errors being raised, frozen for viewing and dumped over the debug UART */
+	captureHandler = createCompactTraceBuffer(captureY, captureDx, NUM_CAPTURE_SAMPLES, DYNAMICS_CHANNELS, 1);
+	setCaptureBuffer(&captureHandler, CAPTURE_PRE_TRIGGER, CAPTURE_POST_TRIGGER);
+	captureTrace = traceView("Captured", &captureHandler, TRACE_ZERO_CENTER, 1, 3, DYNAMICS_VERT_SCALE);
+	capture = listView("Capture", 3);
+	captureTriggerOption = option(CAPTURE_TRIGGER_OFF, CAPTURE_TRIGGER_EITHER);
+	captureTriggerOption.values[CAPTURE_TRIGGER_OFF] = "Off";
+	captureTriggerOption.values[CAPTURE_TRIGGER_COIL] = "Coil";
+	captureTriggerOption.values[CAPTURE_TRIGGER_SPRUNG] = "SprAcc";
+	captureTriggerOption.values[CAPTURE_TRIGGER_EITHER] = "Either";
+	captureTriggerItem = item("Trigger", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, captureTriggerOption, getCaptureTrigger);
+	captureTriggerItem.setter = setCaptureTrigger;
+	captureStateOption = option(TRIGGER_IDLE, TRIGGER_FROZEN);
+	captureStateOption.values[TRIGGER_IDLE] = "Idle";
+	captureStateOption.values[TRIGGER_ARMED] = "Armed";
+	captureStateOption.values[TRIGGER_TRIGGERED] = "Trig'd";
+	captureStateOption.values[TRIGGER_FROZEN] = "Frozen";
+	captureStateItem = item("State", OPTIONTYPE_STRING, OPTIONACCESS_READONLY, captureStateOption, getCaptureState);
+	captureDumpOption = option(0, 1);
+	captureDumpOption.values[0] = "Off";
+	captureDumpOption.values[1] = "On";
+	captureDumpItem = item("Dump", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, captureDumpOption, getCaptureDumping);
+	captureDumpItem.setter = setCaptureDumping;
+	capture.items[0] = captureTriggerItem;
+	capture.items[1] = captureStateItem;
+	capture.items[2] = captureDumpItem;
 
 	/*telemetry GUI*/
 	telemetry = listView("Telemetry", 4);
@@ -114,7 +187,7 @@ int main(void)
 	telemetry.items[3] = coilExtensionItem;
 
 	/*ASC messages GUI*/
-	wusMessages = listView("ASC STAT", 2);
+	wusMessages = listView("ASC STAT", 5);
 	/*
 	   startOption = option(0,1);
 	   startOption.skip = 1;
@@ -130,6 +203,19 @@ int main(void)
 	throttleItem = item("Throttle", OPTIONTYPE_INT, OPTIONACCESS_READONLY, throttleOption, getThrottleStatusDisplay);
 	wusMessages.items[0] = roadTypeItem;
 	wusMessages.items[1] = throttleItem;
+	calibrateOption = option(0, 1);
+	calibrateOption.skip = 1;
+	calibrateOption.values[0] = "Off";
+	calibrateOption.values[1] = "On";
+	calibrateItem = item("Calibrate", OPTIONTYPE_STRING, OPTIONACCESS_MODIFIABLE, calibrateOption, getCalibrationSweeping);
+	calibrateItem.setter = setCalibrationSweeping;
+	wusMessages.items[2] = calibrateItem;
+	baudOption = option(0, 9999);
+	baudItem = item("kBaud", OPTIONTYPE_INT, OPTIONACCESS_READONLY, baudOption, getUartKbaud);
+	wusMessages.items[3] = baudItem;
+	displayBytesOption = option(0, 99999);
+	displayBytesItem = item("OLED B/s", OPTIONTYPE_INT, OPTIONACCESS_READONLY, displayBytesOption, getDisplayBytesPerSecond);
+	wusMessages.items[4] = displayBytesItem;
 	//wusMessages.items[2] = startItem;
 
 	/*Invoked errors GUI*/
@@ -169,6 +255,9 @@ int main(void)
 	mainActivity = activity();
 	addView(&mainActivity, &telemetry, VIEWTYPE_LIST);
 	addView(&mainActivity, &roadSurface, VIEWTYPE_TRACE);
+	addView(&mainActivity, &dynamicsTrace, VIEWTYPE_TRACE);
+	addView(&mainActivity, &captureTrace, VIEWTYPE_TRACE);
+	addView(&mainActivity, &capture, VIEWTYPE_LIST);
 	addView(&mainActivity, &wusMessages, VIEWTYPE_LIST);
 	addView(&mainActivity, &wusStatusEcho, VIEWTYPE_LIST);
 	attachActivity(&mainActivity);
@@ -222,6 +311,7 @@ void vApplicationStackOverflowHook(TaskHandle_t *pxTask, signed char *pcTaskName
 void vApplicationIdleHook(void)
 {
 	/* idle hook*/
+	saveCalibration();
 }
 /*-----------------------------------------------------------*/
 
@@ -47,22 +47,64 @@
 
 #define PULSE_OUT_PERIPH SYSCTL_PERIPH_GPIOB
 #define PULSE_OUT_PORT GPIO_PORTB_BASE
-#define PULSE_OUT_PIN GPIO_PIN_0
+#define PULSE_OUT_PIN GPIO_PIN_0   /**< CCP0, the Timer 0 A PWM output. */
 
-static volatile _iq speed = 0; /**< The internally stored speed. */
+#define PWM_MAX_PERIOD 0xFFFFFF   /**< Longest PWM period, the prescaler gives the top 8 bits of the 16 bit timer. */
+
+typedef enum {PULSEMODE_SOFTWARE, PULSEMODE_HARDWARE} PulseMode;
+
+static long scaledSpeed = -1;     /**< The speed the timer is set up for, in 1/1024 m/s. */
+static unsigned long edgeLoad;    /**< Edge interval the timer is set up for (timer counts), 0 when stopped. */
+static unsigned long pulseClock;  /**< The timer clock (Hz). */
+static PulseMode pulseMode = PULSEMODE_SOFTWARE;
+static volatile unsigned long softwareLoad; /**< Toggle interval for the software mode (timer counts). */
 static volatile unsigned char isPulseHigh = 0;
+static volatile unsigned char isPulseRunning = 0; /**< Software mode toggles the pin. */
 
 /**
- * \brief ISR triggered on Timer 0 completion.
- *
- * Timer0 ISR is used to toggle the encoder output pin at regular intervals,
- * depending on the speed of the car.
+ * \brief ISR triggered by the timer in the software mode, toggles the pin.
  */
 static void isrTimer0 (void);
 
 
 /**
- * \brief Configure Timer0 for pulse train generation.
+ * \brief Sets the timer up to toggle the pin from an interrupt, used when the pulse period is too long for PWM mode.
+ */
+static void setSoftwareMode(void)
+{
+	TimerDisable(TIMER0_BASE, TIMER_A);
+
+	GPIOPinTypeGPIOOutput(PULSE_OUT_PORT, PULSE_OUT_PIN);
+
+	TimerConfigure(TIMER0_BASE, TIMER_CFG_PERIODIC);
+	TimerPrescaleSet(TIMER0_BASE, TIMER_A, 0);
+	TimerLoadSet(TIMER0_BASE, TIMER_A, softwareLoad);
+
+	TimerIntClear(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
+	TimerIntEnable(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
+
+	TimerEnable(TIMER0_BASE, TIMER_A);
+	pulseMode = PULSEMODE_SOFTWARE;
+}
+
+
+/**
+ * \brief Sets the timer up to generate the pulse train on CCP0 with no interrupts.
+ */
+static void setHardwareMode(void)
+{
+	TimerDisable(TIMER0_BASE, TIMER_A);
+	TimerIntDisable(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
+
+	TimerConfigure(TIMER0_BASE, TIMER_CFG_SPLIT_PAIR | TIMER_CFG_A_PWM);
+	GPIOPinTypeTimer(PULSE_OUT_PORT, PULSE_OUT_PIN);
+
+	pulseMode = PULSEMODE_HARDWARE;
+}
+
+
+/**
+ * \brief Initialises Timer 0 for generating the pulse train.
  */
 static void initPulseTimer(void)
 {
@@ -70,21 +112,16 @@ static void initPulseTimer(void)
 	SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER0);
 	SysCtlDelay(SysCtlClockGet() / 3000);
 
-	TimerConfigure(TIMER0_BASE, TIMER_CFG_PERIODIC);
-
-	// Initialise Timer Load
-	TimerLoadSet(TIMER0_BASE, TIMER_A, SysCtlClockGet() / TIMER_FALLBACK_RATE_HZ);
-
 	// Configure Timer Interrupt
 	TimerIntRegister(TIMER0_BASE, TIMER_A, isrTimer0);
-	TimerIntClear(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
-	TimerIntEnable(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
 
 	// Enable Timer Stalling
 	TimerControlStall(TIMER0_BASE, TIMER_A, true);
 
-	// Enable Timer
-	TimerEnable(TIMER0_BASE, TIMER_A);
+	// Start stopped, the timer must still trigger to keep the pin low
+	softwareLoad = pulseClock / TIMER_FALLBACK_RATE_HZ;
+	isPulseRunning = 0;
+	setSoftwareMode();
 }
 
 
@@ -93,25 +130,21 @@ void isrTimer0 (void)
 	// Clear Timer Interrupt
 	TimerIntClear(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
 
-	// Check for zero speed. No pulse is needed in this case, but the timer must still trigger to check for a new speed update.
-	if (speed <= 0)
-	{
-		// Set Timer Interval to the Fallback Rate
-		TimerLoadSet(TIMER0_BASE, TIMER_A, SysCtlClockGet() / TIMER_FALLBACK_RATE_HZ);
-	}
-	else
+	// Reload is computed in setPulseSpeed(), keep this short
+	TimerLoadSet(TIMER0_BASE, TIMER_A, softwareLoad);
+
+	if (isPulseRunning)
 	{
 		// Toggle Encoder Output Pin
 		GPIOPinWrite(PULSE_OUT_PORT, PULSE_OUT_PIN, isPulseHigh);
 		isPulseHigh = ~isPulseHigh;
-
-		// Update Timer Interval. Bit shift to increase precision (approx 1 mm/s)
-		TimerLoadSet(TIMER0_BASE, TIMER_A, (SysCtlClockGet() << 10) / (((long)speed >> (QG - 10)) * PULSE_EDGES_PER_M));
 	}
 }
 
 void initPulseOut()
 {
+	pulseClock = SysCtlClockGet();
+
 	// Enable peripheral
 	SysCtlPeripheralEnable(PULSE_OUT_PERIPH);
 	SysCtlDelay(SysCtlClockGet() / 3000);
@@ -126,6 +159,61 @@ void initPulseOut()
 
 void setPulseSpeed(_iq newSpeed)
 {
-	speed = newSpeed;
-}
+	// Bit shift to increase precision (approx 1 mm/s), speeds within a step give the same interval
+	long newScaledSpeed = (long)newSpeed >> (QG - 10);
+	if (newScaledSpeed < 0)
+	{
+		newScaledSpeed = 0;
+	}
+	if (newScaledSpeed == scaledSpeed)
+	{
+		return;
+	}
+	scaledSpeed = newScaledSpeed;
+
+	// Check for zero speed. No pulse is needed in this case, but the timer must still trigger to check for a new speed update.
+	if (scaledSpeed == 0)
+	{
+		edgeLoad = 0;
+		isPulseRunning = 0;
+		softwareLoad = pulseClock / TIMER_FALLBACK_RATE_HZ;
+		if (pulseMode != PULSEMODE_SOFTWARE)
+		{
+			setSoftwareMode();
+		}
+		GPIOPinWrite(PULSE_OUT_PORT, PULSE_OUT_PIN, 0);
+		return;
+	}
+
+	// Edge interval, close speeds can still round to the same one so leave the timer alone then
+	unsigned long newEdgeLoad = ((unsigned long long)pulseClock << 10) / (scaledSpeed * PULSE_EDGES_PER_M);
+	if (newEdgeLoad == edgeLoad)
+	{
+		return;
+	}
+	edgeLoad = newEdgeLoad;
 
+	if (2 * edgeLoad <= PWM_MAX_PERIOD)
+	{
+		// The hardware makes the whole pulse train down to about 0.15 m/s at 50MHz
+		if (pulseMode != PULSEMODE_HARDWARE)
+		{
+			setHardwareMode();
+		}
+		unsigned long period = 2 * edgeLoad - 1;
+		TimerPrescaleSet(TIMER0_BASE, TIMER_A, period >> 16);
+		TimerLoadSet(TIMER0_BASE, TIMER_A, period & 0xFFFF);
+		TimerPrescaleMatchSet(TIMER0_BASE, TIMER_A, edgeLoad >> 16);
+		TimerMatchSet(TIMER0_BASE, TIMER_A, edgeLoad & 0xFFFF);
+		TimerEnable(TIMER0_BASE, TIMER_A);
+	}
+	else
+	{
+		softwareLoad = edgeLoad;
+		isPulseRunning = 1;
+		if (pulseMode != PULSEMODE_SOFTWARE)
+		{
+			setSoftwareMode();
+		}
+	}
+}
@@ -29,20 +29,27 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
-#include <ustdlib.h>
 
 #include "wus_pulse_out.h"
+#include "wus_telemetry.h"
 #include "shared_pwm.h"
 #include "shared_adc.h"
 #include "shared_uart_task.h"
 #include "shared_parameters.h"
 #include "shared_iqmath.h"
-#include "shared_tracenode.h"
+#include "shared_tracebuffer.h"
+#include "shared_calibration.h"
 
 #include "shared_errors.h"
 
 #define TICK_RATE_HZ ((long)configTICK_RATE_HZ)   /**< The signed tick rate. */
 #define SIMULATE_TASK_RATE_HZ 2000     /**< Task rate, it is borderline stable at 1384Hz. */
+#define TELEMETRY_RATE_HZ 1000         /**< Rate telemetry records are streamed at. */
+#define TELEMETRY_DECIMATION (SIMULATE_TASK_RATE_HZ / TELEMETRY_RATE_HZ)
+#define TELEMETRY_VALUE(value) ((long)(value) >> (QG - TELEMETRY_FRAC_BITS))
+#define DYNAMICS_RATE_HZ 250           /**< Rate the dynamics trace is sampled at. */
+#define DYNAMICS_DECIMATION (SIMULATE_TASK_RATE_HZ / DYNAMICS_RATE_HZ)
+#define DYNAMICS_PERCENT(value, max) ((int)((value) / ((max) / 100))) /**< Value as a percentage of full scale for plotting together, dividing by a constant. */
 
 #define ROAD_RESTORING_FACTOR 200      /**< Road neutral restoring factor. */
 #define ROAD_DAMPING_FACTOR 50          /**< Road damping factor. */
@@ -57,8 +64,31 @@ static _iq sprungAcc = 0;              /**< The sprung mass acceleration (m/s/s)
 static _iq unsprungAcc = 0;            /**< The unsprung mass acceleration (m/s/s). */
 static _iq coilExtension = 0;          /**< The coil extension (mm). */
 static char wusStatusEcho = 0;         /**< The status the needs to be echoed. */
+static volatile int echoPending = 0;   /**< Set when a stamped control frame is waiting to be echoed. */
+static volatile char echoSequence;     /**< Sequence number of the stamped control frame to echo. */
+static volatile char echoTimestamp[2]; /**< Timestamp of the stamped control frame to echo. */
+
+static CompactTraceBuffer *roadBuffer; /**< The road buffer for writing the road to. */
+static CompactTraceBuffer *dynamicsBuffer; /**< The buffer for writing the sprung acceleration, coil extension and force to. */
+static CompactTraceBuffer *captureBuffer; /**< The buffer capturing the dynamics every step around a trigger. */
+static unsigned int capturePre;        /**< Steps to capture before the trigger. */
+static unsigned int capturePost;       /**< Steps to capture after the trigger. */
+static volatile int captureTrigger = CAPTURE_TRIGGER_EITHER; /**< The errors triggering a capture, one of CaptureTrigger. */
+static volatile int captureArmPending = 1; /**< Set when the capture needs arming with a new trigger. */
+static volatile int captureDumpPending = 0; /**< Set when a dump of the frozen capture has been asked for. */
+static volatile int captureDumping = 0; /**< Set while the capture is being dumped. */
+static int captureDumpOffset;          /**< Offset from the trigger of the next sample to dump. */
 
-static CircularBufferHandler *roadBuffer; /**< The road buffer for writing the road to. */
+/**
+ * \brief Errors raised that trigger a capture, indexed by CaptureTrigger.
+ */
+static const char captureTriggerMasks[CAPTURE_TRIGGERS] =
+{
+	0,
+	COIL_EXTENSION_EXCEEDED,
+	ACC_SPRUNG_EXCEEDED,
+	COIL_EXTENSION_EXCEEDED | ACC_SPRUNG_EXCEEDED
+};
 
 /* simulation states */
 static _iq zR = 0;                     /**< The road displacement (mm). */
@@ -93,15 +123,6 @@ static void decodeRoadType();
  */
 static void simulate(int dTime);
 
-/**
- * \brief Reads the throttle from a message.
- *
- * \param msg The message to read.
- *
- * \return The throttle.
- */
-static _iq getThrottle(char *msg);
-
 /**
  * \brief Generates a psuedo random number.
  *
@@ -115,29 +136,79 @@ static _iq getRandom();
 static void putSimOnStops();
 
 /**
- * \brief Reads an incoming UART message.
+ * \brief Reads a binary road type message.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readRoadBinaryMessage(UartFrame *uartFrame)
+{
+	roadType = (unsigned char)uartFrame->frameWise.msg[0];
+	decodeRoadType();
+}
+
+/**
+ * \brief Reads a reset message.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readResetMessage(UartFrame *uartFrame)
+{
+	resetSimulation();
+}
+
+/**
+ * \brief Reads a binary throttle message.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readThrottleBinaryMessage(UartFrame *uartFrame)
+{
+	throttle = (_iq)(short)((unsigned char)uartFrame->frameWise.msg[0] | ((unsigned char)uartFrame->frameWise.msg[1] << 8)) << (QG - UART_BINARY_FRAC_BITS);
+}
+
+/**
+ * \brief Reads a coalesced control message.
  *
  * \param uartFrame Pointer to the uartFrame to read.
  */
-static void readMessage(UartFrame *uartFrame)
+static void readControlMessage(UartFrame *uartFrame)
 {
-	switch (uartFrame->frameWise.msgType)
+	readThrottleBinaryMessage(uartFrame);
+	if (roadType != (unsigned char)uartFrame->frameWise.msg[2])
 	{
-	case 'R':
-		uartFrame->frameWise.msg[2] = '\0';
-		roadType = (int)ustrtoul(uartFrame->frameWise.msg, NULL, 10);
+		roadType = (unsigned char)uartFrame->frameWise.msg[2];
 		decodeRoadType();
-		break;
-	case 'S':
+	}
+	if (uartFrame->frameWise.msg[3] & CONTROL_RESET_FLAG)
+	{
 		resetSimulation();
-		break;
-	case 'A':
-		throttle = getThrottle(uartFrame->frameWise.msg);
-		break;
-	case 'M':
-		wusStatusEcho = uartFrame->frameWise.msg[0];
-		break;
 	}
+	wusStatusEcho = uartFrame->frameWise.msg[4];
+}
+
+/**
+ * \brief Reads a coalesced control message carrying a stamp to echo.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readStampedControlMessage(UartFrame *uartFrame)
+{
+	// echo the stamp back with the next status frame
+	echoSequence = uartFrame->frameWise.msg[5];
+	echoTimestamp[0] = uartFrame->frameWise.msg[6];
+	echoTimestamp[1] = uartFrame->frameWise.msg[7];
+	echoPending = 1;
+	readControlMessage(uartFrame);
+}
+
+/**
+ * \brief Reads an ASC status message.
+ *
+ * \param uartFrame Pointer to the uartFrame to read.
+ */
+static void readStatusMessage(UartFrame *uartFrame)
+{
+	wusStatusEcho = uartFrame->frameWise.msg[0];
 }
 
 /**
@@ -146,8 +217,6 @@ static void readMessage(UartFrame *uartFrame)
  */
 void updateStatus()
 {
-	UartFrame errorStatusSend;
-
 	//max speed error check
 	if (speed >= MAX_SPEED)
 	{
@@ -176,17 +245,141 @@ void updateStatus()
 		combinedError &= ~ACC_UNSPRUNG_EXCEEDED;
 	}
 
-	errorStatusSend.frameWise.msgType = 'W';
-	errorStatusSend.frameWise.msg[0] = combinedError | wusStatusEcho;
-	queueMsgToSend(&errorStatusSend);
+	// build the frame straight into the transmit pool, the next step retries if it is exhausted
+	UartFrame *errorStatusSend = claimMsgToSend();
+	if (errorStatusSend == NULL)
+	{
+		return;
+	}
+
+	errorStatusSend->frameWise.msgType = 'W';
+	errorStatusSend->frameWise.msg[0] = combinedError | wusStatusEcho;
+	int echoing = echoPending;
+	char echoedSequence = echoSequence;
+	if (echoing)
+	{
+		errorStatusSend->frameWise.msgType = STAMPED_STATUS_BINARY_MSG;
+		errorStatusSend->frameWise.msg[1] = echoedSequence;
+		errorStatusSend->frameWise.msg[2] = echoTimestamp[0];
+		errorStatusSend->frameWise.msg[3] = echoTimestamp[1];
+	}
+	commitBinaryMsgToSend(errorStatusSend);
+	if (echoing && echoedSequence == echoSequence)
+	{
+		echoPending = 0; // unless a newer stamp arrived meanwhile
+	}
+}
+
+/**
+ * \brief Streams the simulation state for this step over the debug UART.
+ *
+ * \param timestamp The tick count of the step.
+ */
+static void streamTelemetry(unsigned long timestamp)
+{
+	long values[TELEMETRY_FIELDS];
+
+	values[TELEMETRY_ZR] = TELEMETRY_VALUE(zR);
+	values[TELEMETRY_ZU] = TELEMETRY_VALUE(zU);
+	values[TELEMETRY_ZS] = TELEMETRY_VALUE(zS);
+	values[TELEMETRY_VR] = TELEMETRY_VALUE(vR);
+	values[TELEMETRY_VU] = TELEMETRY_VALUE(vU);
+	values[TELEMETRY_VS] = TELEMETRY_VALUE(vS);
+	values[TELEMETRY_FORCE] = TELEMETRY_VALUE(force);
+	values[TELEMETRY_ERROR] = (unsigned char)combinedError;
+
+	sendTelemetry(timestamp, values);
+}
+
+/**
+ * \brief Captures the dynamics for this step, triggering on the selected errors as they are raised.
+ *
+ * \param dynamics The value of each dynamics channel.
+ */
+static void updateCapture(const int *dynamics)
+{
+	static int step = 0;
+	static char lastErrors = 0;
+	static TraceTriggerState lastState = TRIGGER_IDLE;
+
+	if (captureArmPending)
+	{
+		captureArmPending = 0;
+		captureDumping = 0;
+		if (captureTrigger == CAPTURE_TRIGGER_OFF)
+		{
+			compactTraceDisarm(captureBuffer);
+		}
+		else
+		{
+			compactTraceArm(captureBuffer, capturePre, capturePost);
+		}
+	}
+
+	compactTraceWrite(captureBuffer, ++step, dynamics);
+
+	// trigger on the rising edge of the selected errors
+	char errors = combinedError & captureTriggerMasks[captureTrigger];
+	if (errors & ~lastErrors)
+	{
+		compactTraceTrigger(captureBuffer);
+	}
+	lastErrors = errors;
+
+	TraceTriggerState state = captureBuffer->trigger.state;
+	if ((state == TRIGGER_FROZEN && lastState != TRIGGER_FROZEN) || captureDumpPending)
+	{
+		captureDumpPending = 0;
+		captureDumpOffset = -(int)capturePre; // from the oldest sample
+		captureDumping = (state == TRIGGER_FROZEN);
+	}
+	lastState = state;
+}
+
+/**
+ * \brief Sends the next sample of a frozen capture over the debug UART, if there is room.
+ */
+static void dumpCapture()
+{
+	const short *row;
+	int dx;
+
+	if (!captureDumping)
+	{
+		return;
+	}
+
+	if (compactTraceCaptureRow(captureBuffer, captureDumpOffset, &row, &dx) != 0)
+	{
+		captureDumping = 0; // the capture was re-armed
+		return;
+	}
+	if (sendTelemetryCapture(captureDumpOffset, dx, row, DYNAMICS_CHANNELS) == 0 && ++captureDumpOffset > (int)capturePost)
+	{
+		captureDumping = 0;
+	}
 }
 
 void vSimulateTask(void *params)
 {
 	initPulseOut();
+	initTelemetry();
+	initCalibration();
 	initAdcModule(ACTUATOR_FORCE_ADC | DAMPING_COEFF_ADC);
 	initPwmModule(ACC_SPRUNG_PWM | ACC_UNSPRUNG_PWM | COIL_EXTENSION_PWM);
-	attachOnReceiveCallback(readMessage);
+	setPwmRange(ACC_SPRUNG_PWM, MIN_ACC_SPRUNG, MAX_ACC_SPRUNG);
+	setPwmRange(ACC_UNSPRUNG_PWM, MIN_ACC_UNSPRUNG, MAX_ACC_UNSPRUNG);
+	setPwmRange(COIL_EXTENSION_PWM, MIN_COIL_EXTENSION, MAX_COIL_EXTENSION);
+	setPwmDither(ACC_SPRUNG_PWM, 1);
+	setPwmDither(ACC_UNSPRUNG_PWM, 1);
+	registerMsgType(ROAD_BINARY_MSG, ROAD_BINARY_LEN, 1, readRoadBinaryMessage);
+	registerMsgType('S', RESET_MSG_LEN, 1, readResetMessage);
+	registerMsgType(THROTTLE_BINARY_MSG, THROTTLE_BINARY_LEN, 1, readThrottleBinaryMessage);
+	registerMsgType(CONTROL_BINARY_MSG, CONTROL_BINARY_LEN, 1, readControlMessage);
+	registerMsgType(STAMPED_CONTROL_BINARY_MSG, STAMPED_CONTROL_BINARY_LEN, 1, readStampedControlMessage);
+	registerMsgType('M', ASC_STATUS_MSG_LEN, 1, readStatusMessage);
+	registerMsgType('W', WUS_STATUS_MSG_LEN, 1, NULL);
+	registerMsgType(STAMPED_STATUS_BINARY_MSG, STAMPED_STATUS_BINARY_LEN, 1, NULL);
 
 	// initialize FreeRTOS sleep parameters
 	TickType_t pxPreviousWakeTime;
@@ -194,6 +387,12 @@ void vSimulateTask(void *params)
 	pxPreviousWakeTime = xTaskGetTickCount();
 
 	int distanceTravelled = 0;
+	_iq pwmValues[PWM_NUM_OUTS];
+	unsigned int telemetryStep = 0;
+	unsigned int dynamicsStep = 0;
+	int dynamicsSample = 0;
+	int road[1];
+	int dynamics[DYNAMICS_CHANNELS];
 
 	for (;;)
 	{
@@ -208,13 +407,50 @@ void vSimulateTask(void *params)
 		distanceTravelled += 100;
 
 		setPulseSpeed(speed);
-		setDuty(ACC_SPRUNG_PWM, sprungAcc, MIN_ACC_SPRUNG, MAX_ACC_SPRUNG);
-		setDuty(ACC_UNSPRUNG_PWM, unsprungAcc, MIN_ACC_UNSPRUNG, MAX_ACC_UNSPRUNG);
-		setDuty(COIL_EXTENSION_PWM, coilExtension, MIN_COIL_EXTENSION, MAX_COIL_EXTENSION);
+		int calibrationPoint = updateCalibrationSweep();
+		if (calibrationPoint < 0)
+		{
+			pwmValues[ACC_SPRUNG_PWM_INDEX] = sprungAcc;
+			pwmValues[ACC_UNSPRUNG_PWM_INDEX] = unsprungAcc;
+			pwmValues[COIL_EXTENSION_PWM_INDEX] = coilExtension;
+		}
+		else
+		{
+			// sweep the outputs for the ASC to calibrate against
+			pwmValues[ACC_SPRUNG_PWM_INDEX] = CALIBRATION_VALUE(calibrationPoint, MIN_ACC_SPRUNG, MAX_ACC_SPRUNG);
+			pwmValues[ACC_UNSPRUNG_PWM_INDEX] = CALIBRATION_VALUE(calibrationPoint, MIN_ACC_UNSPRUNG, MAX_ACC_UNSPRUNG);
+			pwmValues[COIL_EXTENSION_PWM_INDEX] = CALIBRATION_VALUE(calibrationPoint, MIN_COIL_EXTENSION, MAX_COIL_EXTENSION);
+		}
+		setDutyBatch(pwmValues);
+
+		road[0] = _IQint(zR);
+		compactTraceWrite(roadBuffer, distanceTravelled, road);
 
-		circularBufferWrite(roadBuffer, distanceTravelled, _IQint(zR));
+		dynamics[DYNAMICS_ACC_SPRUNG] = DYNAMICS_PERCENT(sprungAcc, MAX_ACC_SPRUNG);
+		dynamics[DYNAMICS_COIL_EXTENSION] = DYNAMICS_PERCENT(coilExtension, MAX_COIL_EXTENSION);
+		dynamics[DYNAMICS_FORCE] = DYNAMICS_PERCENT(force, MAX_ACTUATOR_FORCE);
+		if (dynamicsBuffer != NULL && ++dynamicsStep >= DYNAMICS_DECIMATION)
+		{
+			compactTraceWrite(dynamicsBuffer, ++dynamicsSample, dynamics);
+			dynamicsStep = 0;
+		}
 
 		updateStatus();
+
+		if (captureBuffer != NULL)
+		{
+			updateCapture(dynamics);
+		}
+
+		if (++telemetryStep >= TELEMETRY_DECIMATION)
+		{
+			streamTelemetry(pxPreviousWakeTime);
+			telemetryStep = 0;
+			if (captureBuffer != NULL)
+			{
+				dumpCapture();
+			}
+		}
 	}
 }
 
@@ -309,11 +545,55 @@ int getDisplayCoilExtension()
 	return _IQint(coilExtension);
 }
 
-void setRoadBuffer(CircularBufferHandler *buffer)
+void setRoadBuffer(CompactTraceBuffer *buffer)
 {
 	roadBuffer = buffer;
 }
 
+void setDynamicsBuffer(CompactTraceBuffer *buffer)
+{
+	dynamicsBuffer = buffer;
+}
+
+void setCaptureBuffer(CompactTraceBuffer *buffer, unsigned int pre, unsigned int post)
+{
+	capturePre = pre;
+	capturePost = post;
+	captureBuffer = buffer;
+}
+
+int getCaptureTrigger()
+{
+	return captureTrigger;
+}
+
+void setCaptureTrigger(int trigger)
+{
+	if (trigger >= 0 && trigger < CAPTURE_TRIGGERS)
+	{
+		captureTrigger = trigger;
+		captureArmPending = 1; // armed by the simulate task, the only writer of the buffer
+	}
+}
+
+int getCaptureState()
+{
+	return captureBuffer != NULL ? captureBuffer->trigger.state : TRIGGER_IDLE;
+}
+
+int getCaptureDumping()
+{
+	return captureDumping;
+}
+
+void setCaptureDumping(int dump)
+{
+	if (dump)
+	{
+		captureDumpPending = 1;
+	}
+}
+
 void resetSimulation()
 {
 	speed = 0;
@@ -419,23 +699,6 @@ void putSimOnStops()
 	vS = vU;
 }
 
-_iq getThrottle(char *msg)
-{
-	int throttleInt = 1000 * (msg[1] - '0') + 100 * (msg[3] - '0') + 10 * (msg[4] - '0') + (msg[5] - '0');
-	if (msg[0] == '-')
-	{
-		// negative case
-		throttleInt = -throttleInt;
-	}
-	else if (msg[0] >= '1' && msg[0] <= '9')
-	{
-		// 10 case
-		throttleInt = 10000 * (msg[0] - '0');
-	}
-
-	return _IQ(throttleInt) / 1000;
-}
-
 _iq getRandom()
 {
 	static unsigned long b = 12903;
@@ -0,0 +1,228 @@
+/**
+ * \file wus_telemetry.c
+ * \brief Streams the simulation state over the debug UART as delta encoded binary records.
+ * \author James Duley
+ * \version 1.0
+ * \date 2014-10-18
+ */
+
+/* Copyright (C)
+ * 2014 - James Duley
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include "wus_telemetry.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_ints.h"
+#include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/uart.h"
+#include "utils/crc.h"
+#include "utils/ringbuf.h"
+
+#define TELEMETRY_BUFFER_SIZE 512
+
+static tRingBufObject txRing;
+static unsigned char txBuffer[TELEMETRY_BUFFER_SIZE];
+
+static Compressor compressor;            /**< Holds the values the decoder has after the last record sent. */
+static unsigned long lastTimestamp;
+static unsigned int recordsSinceKey = TELEMETRY_KEY_INTERVAL; /**< Starts due so the first record is a key. */
+
+/**
+ * \brief ISR refilling the debug UART FIFO from the transmit ring.
+ */
+void isrUart0(void);
+
+/**
+ * \brief Moves bytes from the transmit ring into the UART FIFO until it is full.
+ *
+ * Must be called from the ISR or with the UART interrupt masked.
+ */
+static void fillTxFifo(void)
+{
+	while (UARTSpaceAvail(UART0_BASE) && !RingBufEmpty(&txRing))
+	{
+		UARTCharPutNonBlocking(UART0_BASE, RingBufReadOne(&txRing));
+	}
+}
+
+/**
+ * \brief Appends a little endian value to a record.
+ *
+ * \param out Where to write
+ * \param value The value
+ * \param size Number of bytes to write
+ * \return Number of bytes written
+ */
+static unsigned int putLittleEndian(unsigned char *out, unsigned long value, unsigned int size)
+{
+	unsigned int i;
+	for (i = 0; i < size; i++)
+	{
+		out[i] = (unsigned char)(value >> (8 * i));
+	}
+	return size;
+}
+
+/**
+ * \brief Encodes a key or delta record against the last values sent, which it then updates.
+ *
+ * \param record Buffer of at least TELEMETRY_MAX_RECORD bytes
+ * \param timestamp The RTOS tick count of the step
+ * \param values The fields
+ * \param key Whether to encode a key record
+ * \return Length of the record
+ */
+static unsigned int encodeRecord(unsigned char *record, unsigned long timestamp, const int32_t values[TELEMETRY_FIELDS], int key)
+{
+	unsigned char *payload = &record[TELEMETRY_HEADER_SIZE];
+	unsigned int length = 0;
+	unsigned int field;
+
+	if (key)
+	{
+		length += putLittleEndian(&payload[length], timestamp, 4);
+		for (field = 0; field < TELEMETRY_FIELDS; field++)
+		{
+			length += putLittleEndian(&payload[length], values[field], 4);
+		}
+		compressorSetLast(&compressor, values);
+	}
+	else
+	{
+		payload[length++] = (unsigned char)(timestamp - lastTimestamp);
+		length += compressRecord(&compressor, values, &payload[length]);
+	}
+
+	record[0] = TELEMETRY_SYNC;
+	record[1] = key ? TELEMETRY_KEY_RECORD : TELEMETRY_DELTA_RECORD;
+	record[2] = length;
+	record[TELEMETRY_HEADER_SIZE + length] = Crc8CCITT(0, &record[1], length + 2);
+
+	return TELEMETRY_HEADER_SIZE + length + 1;
+}
+
+void initTelemetry(void)
+{
+	compressorInit(&compressor, TELEMETRY_FIELDS, TELEMETRY_RUN_LENGTH);
+	RingBufInit(&txRing, txBuffer, TELEMETRY_BUFFER_SIZE);
+
+	SysCtlPeripheralEnable(SYSCTL_PERIPH_UART0);
+	SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOA);
+	GPIOPinTypeUART(GPIO_PORTA_BASE, GPIO_PIN_0 | GPIO_PIN_1);
+
+	UARTConfigSetExpClk(UART0_BASE, SysCtlClockGet(), TELEMETRY_BAUD, UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE);
+
+	// interrupt when the transmit FIFO is nearly empty
+	UARTFIFOLevelSet(UART0_BASE, UART_FIFO_TX1_8, UART_FIFO_RX4_8);
+	UARTIntRegister(UART0_BASE, isrUart0);
+	IntPrioritySet(INT_UART0, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	UARTIntEnable(UART0_BASE, UART_INT_TX);
+	UARTEnable(UART0_BASE);
+}
+
+void sendTelemetry(unsigned long timestamp, const long values[TELEMETRY_FIELDS])
+{
+	unsigned char record[TELEMETRY_MAX_RECORD];
+	int32_t fields[TELEMETRY_FIELDS];
+	unsigned int field;
+
+	for (field = 0; field < TELEMETRY_FIELDS; field++)
+	{
+		fields[field] = values[field];
+	}
+
+	int key = recordsSinceKey >= TELEMETRY_KEY_INTERVAL || timestamp - lastTimestamp > 0xFF;
+	unsigned int length = encodeRecord(record, timestamp, fields, key);
+	int sent = 0;
+
+	taskENTER_CRITICAL();
+	if (RingBufFree(&txRing) >= length)
+	{
+		RingBufWrite(&txRing, record, length);
+
+		// the transmit interrupt only fires on the FIFO draining, so start it off
+		fillTxFifo();
+		sent = 1;
+	}
+	taskEXIT_CRITICAL();
+
+	if (sent)
+	{
+		lastTimestamp = timestamp;
+		recordsSinceKey = key ? 1 : recordsSinceKey + 1;
+	}
+	else
+	{
+		// the decoder has lost track of the deltas
+		recordsSinceKey = TELEMETRY_KEY_INTERVAL;
+	}
+}
+
+int sendTelemetryCapture(int offset, int dx, const short *row, unsigned int channels)
+{
+	unsigned char record[TELEMETRY_HEADER_SIZE + TELEMETRY_CAPTURE_HEADER + 2 * TELEMETRY_CAPTURE_MAX_CHANNELS + 1];
+	unsigned char *payload = &record[TELEMETRY_HEADER_SIZE];
+	unsigned int length = 0;
+	unsigned int channel;
+
+	if (channels > TELEMETRY_CAPTURE_MAX_CHANNELS)
+	{
+		channels = TELEMETRY_CAPTURE_MAX_CHANNELS;
+	}
+
+	length += putLittleEndian(&payload[length], (unsigned long)offset, 2);
+	length += putLittleEndian(&payload[length], (unsigned long)dx, 2);
+	for (channel = 0; channel < channels; channel++)
+	{
+		length += putLittleEndian(&payload[length], (unsigned long)row[channel], 2);
+	}
+
+	record[0] = TELEMETRY_SYNC;
+	record[1] = TELEMETRY_CAPTURE_RECORD;
+	record[2] = length;
+	record[TELEMETRY_HEADER_SIZE + length] = Crc8CCITT(0, &record[1], length + 2);
+	length += TELEMETRY_HEADER_SIZE + 1;
+
+	int sent = -1;
+	taskENTER_CRITICAL();
+	if (RingBufFree(&txRing) >= length + TELEMETRY_MAX_RECORD)
+	{
+		RingBufWrite(&txRing, record, length);
+		fillTxFifo();
+		sent = 0;
+	}
+	taskEXIT_CRITICAL();
+
+	return sent;
+}
+
+void isrUart0(void)
+{
+	unsigned long status = UARTIntStatus(UART0_BASE, true);
+	UARTIntClear(UART0_BASE, status);
+
+	if (status & UART_INT_TX)
+	{
+		fillTxFifo();
+	}
+}